@@ -1,9 +1,16 @@
 #include "1-wire.h"
 #include "tim.h"
+#include "FreeRTOS.h"
+#include "task.h"
 
+void OneWire_Init(void) {
+    HAL_TIM_Base_Start(&htim2);
+}
+
+/* TIM2 keeps running freely, it is the RTC calibration reference and the run-time statistics clock. */
 void OneWire_Delay(uint16_t us) {
-    __HAL_TIM_SET_COUNTER(&htim2, 0);
-    while (__HAL_TIM_GET_COUNTER(&htim2) < us);
+    uint32_t start = __HAL_TIM_GET_COUNTER(&htim2);
+    while (__HAL_TIM_GET_COUNTER(&htim2) - start < us);
 }
 
 void OneWire_SetPinOutput(void) {
@@ -40,6 +47,7 @@ uint8_t OneWire_Reset(void) {
 }
 
 void OneWire_WriteBit(uint8_t bit) {
+    taskENTER_CRITICAL();
     OneWire_SetPinOutput();
 
     HAL_GPIO_WritePin(ONEWIRE_PORT, ONEWIRE_PIN, GPIO_PIN_RESET);
@@ -47,11 +55,13 @@ void OneWire_WriteBit(uint8_t bit) {
 
     HAL_GPIO_WritePin(ONEWIRE_PORT, ONEWIRE_PIN, GPIO_PIN_SET);
     OneWire_Delay(bit ? 55 : 5);
+    taskEXIT_CRITICAL();
 }
 
 uint8_t OneWire_ReadBit(void) {
     uint8_t bit = 0;
 
+    taskENTER_CRITICAL();
     OneWire_SetPinOutput();
     HAL_GPIO_WritePin(ONEWIRE_PORT, ONEWIRE_PIN, GPIO_PIN_RESET);
     OneWire_Delay(3);
@@ -61,6 +71,7 @@ uint8_t OneWire_ReadBit(void) {
 
     bit = HAL_GPIO_ReadPin(ONEWIRE_PORT, ONEWIRE_PIN);
     OneWire_Delay(50);
+    taskEXIT_CRITICAL();
 
     return bit;
 }
@@ -0,0 +1,127 @@
+/**
+ * Publish/subscribe data bus
+ *
+ * Every topic has a fixed payload type, defined by its producer, and keeps
+ * the last value published to it, so a reader that starts late or only
+ * needs the current state gets it without asking the producer. Publishing
+ * copies the payload into the cache and sets the thread flags of every
+ * subscriber of the topic; the subscriber then reads the cache. A
+ * subscriber woken late only sees the newest value, which is all any
+ * consumer here needs.
+ *
+ * The bus only sees payloads as bytes. The first publish fixes the size of
+ * a topic; later publishes and all reads have to match it.
+ *
+ * Publishing and reading work from tasks and interrupts. The copy is done
+ * with interrupts masked, so payloads are kept to a few hundred bytes.
+ */
+
+#include "data_bus.h"
+
+#include <string.h>
+#include "FreeRTOS.h"
+#include "task.h"
+
+typedef struct
+{
+    osThreadId_t thread;
+    uint32_t flags;
+} data_bus_subscriber_t;
+
+typedef struct
+{
+    uint8_t cache[DATA_BUS_MAX_PAYLOAD_SIZE];
+    uint32_t size;
+    uint32_t sequence;
+    data_bus_subscriber_t subscribers[DATA_BUS_MAX_SUBSCRIBERS];
+    uint8_t subscriber_count;
+} data_bus_entry_t;
+
+typedef struct
+{
+    data_bus_entry_t topics[DATA_BUS_TOPIC_NUMBER];
+} data_bus_handler_t;
+
+static data_bus_handler_t data_bus_handler;
+
+bool data_bus_subscribe(data_bus_topic_t topic, osThreadId_t thread, uint32_t flags)
+{
+    bool subscribed = false;
+
+    if (topic >= DATA_BUS_TOPIC_NUMBER || thread == NULL || flags == 0)
+    {
+        return false;
+    }
+
+    data_bus_entry_t *entry = &data_bus_handler.topics[topic];
+
+    UBaseType_t interrupt_state = taskENTER_CRITICAL_FROM_ISR();
+    if (entry->subscriber_count < DATA_BUS_MAX_SUBSCRIBERS)
+    {
+        entry->subscribers[entry->subscriber_count].thread = thread;
+        entry->subscribers[entry->subscriber_count].flags = flags;
+        entry->subscriber_count++;
+        subscribed = true;
+    }
+    taskEXIT_CRITICAL_FROM_ISR(interrupt_state);
+
+    return subscribed;
+}
+
+/* Subscribers are only ever appended, so the count read with the copy covers initialised entries. */
+bool data_bus_publish(data_bus_topic_t topic, const void *data, uint32_t size)
+{
+    if (topic >= DATA_BUS_TOPIC_NUMBER || data == NULL || size == 0 || size > DATA_BUS_MAX_PAYLOAD_SIZE)
+    {
+        return false;
+    }
+
+    data_bus_entry_t *entry = &data_bus_handler.topics[topic];
+
+    UBaseType_t interrupt_state = taskENTER_CRITICAL_FROM_ISR();
+    if (entry->sequence != 0 && entry->size != size)
+    {
+        taskEXIT_CRITICAL_FROM_ISR(interrupt_state);
+        return false;
+    }
+
+    memcpy(entry->cache, data, size);
+    entry->size = size;
+
+    /* 0 is left for a topic nothing was published to. */
+    if (++entry->sequence == 0)
+    {
+        entry->sequence = 1;
+    }
+
+    uint8_t count = entry->subscriber_count;
+    taskEXIT_CRITICAL_FROM_ISR(interrupt_state);
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        osThreadFlagsSet(entry->subscribers[i].thread, entry->subscribers[i].flags);
+    }
+
+    return true;
+}
+
+/* Returns the sequence number of the value copied out, 0 when the topic has none yet or the size differs. */
+uint32_t data_bus_read(data_bus_topic_t topic, void *data, uint32_t size)
+{
+    if (topic >= DATA_BUS_TOPIC_NUMBER || data == NULL)
+    {
+        return 0;
+    }
+
+    data_bus_entry_t *entry = &data_bus_handler.topics[topic];
+
+    UBaseType_t interrupt_state = taskENTER_CRITICAL_FROM_ISR();
+    uint32_t sequence = (entry->size == size) ? entry->sequence : 0;
+    if (sequence != 0)
+    {
+        memcpy(data, entry->cache, size);
+    }
+    taskEXIT_CRITICAL_FROM_ISR(interrupt_state);
+
+    return sequence;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "cmsis_os.h"
+
+#define DATA_BUS_MAX_SUBSCRIBERS 4
+#define DATA_BUS_MAX_PAYLOAD_SIZE 256
+
+/* Payload types are defined by the producer of each topic. */
+typedef enum
+{
+    DATA_BUS_TOPIC_TEMPERATURE,   /* temperature_samples_t, temperature_sensor.h */
+    DATA_BUS_TOPIC_HEATER_STATUS, /* heater_statuses_t, heater.h */
+    DATA_BUS_TOPIC_TIME_TICK,     /* rtc_time_tick_t, rtc_module.h */
+    DATA_BUS_TOPIC_ALARM,         /* temperature_alarm_t, temperature_sensor.h */
+
+    DATA_BUS_TOPIC_NUMBER,
+} data_bus_topic_t;
+
+bool data_bus_subscribe(data_bus_topic_t topic, osThreadId_t thread, uint32_t flags);
+bool data_bus_publish(data_bus_topic_t topic, const void *data, uint32_t size);
+uint32_t data_bus_read(data_bus_topic_t topic, void *data, uint32_t size);
@@ -9,12 +9,20 @@
 #include "main.h"
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
 #include <rtc.h>
 
 #include "rtc_module.h"
+#include "stack_monitor.h"
+#include "data_bus.h"
 
 #define LCD_TASK_STACK_SIZE (254 * 8)
 #define LCD_TASK_PRIORITY   osPriorityNormal
+#define LCD_LINE_SPACING    15
+#define DISPLAY_FLAG_TIME_TICK 0x01u
+#define DISPLAY_FLAG_TEMPERATURE 0x02u
+#define DISPLAY_REFRESH_TIMEOUT_MS 1500
+#define DISPLAY_MIN_REDRAW_MS 500
 
 typedef struct {
     char label[32];
@@ -31,6 +39,9 @@ typedef struct {
 
 static display_handler_t display_handler;
 
+static StaticTask_t display_task_control_block;
+static StackType_t display_task_stack[LCD_TASK_STACK_SIZE / sizeof(StackType_t)];
+
 static void display_task(void *argument);
 
 bool display_init(void)
@@ -49,16 +60,21 @@ bool display_init(void)
     strncpy(display_handler.time_field.label, "Time:", sizeof(display_handler.time_field.label) - 1);
     display_handler.time_field.color = WHITE;
     display_handler.time_field.x = 10;
-    display_handler.time_field.y = 30;
+    display_handler.time_field.y = display_handler.temperature_field.y + LCD_LINE_SPACING * (TEMPERATURE_SENSOR_CHANNEL_NUMBER + 1);
 
     const osThreadAttr_t task_attributes = {
         .name = "DisplayTask",
         .priority = LCD_TASK_PRIORITY,
-        .stack_size = LCD_TASK_STACK_SIZE
+        .cb_mem = &display_task_control_block,
+        .cb_size = sizeof(display_task_control_block),
+        .stack_mem = display_task_stack,
+        .stack_size = sizeof(display_task_stack)
     };
 
     display_handler.task_handle = osThreadNew(display_task, NULL, &task_attributes);
-    task_ok = (display_handler.task_handle != NULL);
+    task_ok = (display_handler.task_handle != NULL) && stack_monitor_register(display_handler.task_handle, sizeof(display_task_stack)) &&
+              data_bus_subscribe(DATA_BUS_TOPIC_TIME_TICK, display_handler.task_handle, DISPLAY_FLAG_TIME_TICK) &&
+              data_bus_subscribe(DATA_BUS_TOPIC_TEMPERATURE, display_handler.task_handle, DISPLAY_FLAG_TEMPERATURE);
 
     return task_ok && lcd_ok;
 }
@@ -66,22 +82,37 @@ bool display_init(void)
 static void display_temperature()
 {
 	char buffer[64];
-	sprintf(buffer, "%s %0.2f",display_handler.temperature_field.label, temperature_sensor_get_temperature());
+    temperature_samples_t samples;
+    bool samples_ok = data_bus_read(DATA_BUS_TOPIC_TEMPERATURE, &samples, sizeof(samples)) != 0;
 
     lcd_display_string(
         display_handler.temperature_field.x,
 		display_handler.temperature_field.y,
-        buffer,
+        display_handler.temperature_field.label,
 		display_handler.temperature_field.color,
         LCD_FONT12
     );
+
+    for (int i = 0; i < TEMPERATURE_SENSOR_CHANNEL_NUMBER; i++)
+    {
+        sprintf(buffer, "%s %0.2f", temperature_sensor_get_channel_name(i), samples_ok ? samples.channels[i].temperature : NAN);
+
+        lcd_display_string(
+            display_handler.temperature_field.x,
+            display_handler.temperature_field.y + LCD_LINE_SPACING * (i + 1),
+            buffer,
+            display_handler.temperature_field.color,
+            LCD_FONT12
+        );
+    }
 }
 
 static void display_time()
 {
 	char buffer[64];
-	RTC_TimeTypeDef time = rtc_get_time_struct();
-	sprintf(buffer, "%s %02d:%02d:%02d",display_handler.time_field.label, time.Hours, time.Minutes, time.Seconds);
+	rtc_time_tick_t tick = {0};
+	data_bus_read(DATA_BUS_TOPIC_TIME_TICK, &tick, sizeof(tick));
+	sprintf(buffer, "%s %02d:%02d:%02d",display_handler.time_field.label, tick.time.Hours, tick.time.Minutes, tick.time.Seconds);
 
     lcd_display_string(
         display_handler.time_field.x,
@@ -97,12 +128,28 @@ static void display_task(void *argument)
     (void)argument;
     for (;;)
     {
+        uint32_t redraw_tick = osKernelGetTickCount();
+
     	lcd_fill(BLACK);
     	osDelay(50);
         display_temperature();
         display_time();
         lcd_copy();
-        osDelay(500);
+
+        uint32_t flags = osThreadFlagsWait(DISPLAY_FLAG_TIME_TICK | DISPLAY_FLAG_TEMPERATURE, osFlagsWaitAny, DISPLAY_REFRESH_TIMEOUT_MS);
+
+        /* New samples alone redraw at most every DISPLAY_MIN_REDRAW_MS, a new second is drawn at once. */
+        if ((flags & osFlagsError) == 0 && (flags & DISPLAY_FLAG_TIME_TICK) == 0)
+        {
+            uint32_t elapsed = osKernelGetTickCount() - redraw_tick;
+
+            if (elapsed < DISPLAY_MIN_REDRAW_MS)
+            {
+                osThreadFlagsWait(DISPLAY_FLAG_TIME_TICK, osFlagsWaitAny, DISPLAY_MIN_REDRAW_MS - elapsed);
+            }
+
+            osThreadFlagsClear(DISPLAY_FLAG_TEMPERATURE);
+        }
     }
 }
 
@@ -1,16 +1,44 @@
 #include "ds18b20.h"
 
-float DS18B20_GetTemperature(void) {
-    uint8_t lsb, msb;
-    int16_t temp;
+#define DS18B20_RESOLUTION  0.0625f
 
-    if (!OneWire_Reset()) return -1000;
+static bool ds18b20_init(void);
+
+const temperature_sensor_driver_t ds18b20_driver =
+{
+    .name = "DS18B20",
+    .init = ds18b20_init,
+    .start_conversion = DS18B20_StartConversion,
+    .read = DS18B20_ReadTemperature,
+    .capabilities =
+    {
+        .resolution = DS18B20_RESOLUTION,
+        .conversion_time_ms = DS18B20_CONVERSION_TIME_MS,
+        .sample_period_ms = DS18B20_CONVERSION_TIME_MS,
+    },
+};
+
+static bool ds18b20_init(void) {
+    OneWire_Init();
+
+    return OneWire_Reset();
+}
+
+bool DS18B20_StartConversion(void) {
+    if (!OneWire_Reset()) return false;
 
     OneWire_WriteByte(DS18B20_CMD_SKIP_ROM);
     OneWire_WriteByte(DS18B20_CMD_CONVERT_T);
-    HAL_Delay(750);
 
-    OneWire_Reset();
+    return true;
+}
+
+bool DS18B20_ReadTemperature(float *temperature) {
+    uint8_t lsb, msb;
+    int16_t temp;
+
+    if (!OneWire_Reset()) return false;
+
     OneWire_WriteByte(DS18B20_CMD_SKIP_ROM);
     OneWire_WriteByte(DS18B20_CMD_READ_SCRATCHPAD);
 
@@ -18,6 +46,19 @@ float DS18B20_GetTemperature(void) {
     msb = OneWire_ReadByte();
 
     temp = (msb << 8) | lsb;
+    *temperature = (float)temp * DS18B20_RESOLUTION;
+
+    return true;
+}
+
+float DS18B20_GetTemperature(void) {
+    float temperature;
+
+    if (!DS18B20_StartConversion()) return -1000;
+
+    HAL_Delay(DS18B20_CONVERSION_TIME_MS);
+
+    if (!DS18B20_ReadTemperature(&temperature)) return -1000;
 
-    return (float)temp / 16.0;
+    return temperature;
 }
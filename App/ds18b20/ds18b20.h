@@ -1,10 +1,17 @@
 #pragma once
 
+#include <stdbool.h>
 #include "1-wire.h"
+#include "temperature_sensor_driver.h"
 
 #define DS18B20_CMD_CONVERT_T  0x44
 #define DS18B20_CMD_READ_SCRATCHPAD  0xBE
 #define DS18B20_CMD_SKIP_ROM  0xCC
 
-float DS18B20_GetTemperature(void);
+#define DS18B20_CONVERSION_TIME_MS  750
+
+extern const temperature_sensor_driver_t ds18b20_driver;
 
+bool DS18B20_StartConversion(void);
+bool DS18B20_ReadTemperature(float *temperature);
+float DS18B20_GetTemperature(void);
@@ -0,0 +1,300 @@
+/**
+ * Relay-feedback PID auto-tuner (Astrom-Hagglund)
+ *
+ * The heater is switched between two output levels around the setpoint
+ * with hysteresis. The limit cycle gives the ultimate gain and period.
+ * The delay from a relay switch to the next temperature extremum gives the
+ * dead time, and the difference between the heating and cooling slopes
+ * gives the integrating gain K/tau. Together they identify the first order
+ * plus dead time model used by the SIMC rule; when tau is too long to be
+ * separated from K the process is treated as integrating. The time spent
+ * at the high output over the measured cycles gives the mean output the
+ * controller takes over from.
+ */
+
+#include "autotune.h"
+
+#include <math.h>
+#include <stddef.h>
+
+#define DISCARDED_HALF_CYCLES 2
+#define PI_F 3.14159265f
+
+static void finish_half_cycle(autotune_t *tuner, float temperature);
+static void identify(autotune_t *tuner);
+
+void autotune_start(autotune_t *tuner, const autotune_config_t *config)
+{
+    tuner->config = *config;
+    tuner->state = AUTOTUNE_STATE_RUNNING;
+
+    tuner->relay_high = false;
+    tuner->started = false;
+    tuner->elapsed = 0.0f;
+    tuner->half_start_time = 0.0f;
+    tuner->last_rising_switch_time = 0.0f;
+    tuner->cycle_high_time = 0.0f;
+    tuner->extremum = NAN;
+    tuner->extremum_time = 0.0f;
+
+    tuner->half_cycles = 0;
+    tuner->cycles_measured = 0;
+    tuner->max_sum = 0.0f;
+    tuner->min_sum = 0.0f;
+    tuner->period_sum = 0.0f;
+    tuner->high_time_sum = 0.0f;
+    tuner->dead_time_sum = 0.0f;
+    tuner->rise_slope_sum = 0.0f;
+    tuner->fall_slope_sum = 0.0f;
+    tuner->max_count = 0;
+    tuner->min_count = 0;
+    tuner->dead_time_count = 0;
+    tuner->rise_slope_count = 0;
+    tuner->fall_slope_count = 0;
+}
+
+void autotune_stop(autotune_t *tuner)
+{
+    if (tuner->state == AUTOTUNE_STATE_RUNNING)
+    {
+        tuner->state = AUTOTUNE_STATE_IDLE;
+    }
+}
+
+float autotune_update(autotune_t *tuner, float temperature, float dt)
+{
+    if (tuner->state != AUTOTUNE_STATE_RUNNING)
+    {
+        return tuner->config.output_low;
+    }
+
+    tuner->elapsed += dt;
+
+    if (tuner->elapsed > tuner->config.timeout_s || isnan(temperature))
+    {
+        tuner->state = AUTOTUNE_STATE_FAILED;
+        return tuner->config.output_low;
+    }
+
+    /* The output of the interval just ended is the relay state before this update switches it. */
+    if (tuner->started && tuner->relay_high)
+    {
+        tuner->cycle_high_time += dt;
+    }
+
+    if (!tuner->started)
+    {
+        tuner->started = true;
+        tuner->relay_high = temperature < tuner->config.setpoint;
+        tuner->half_start_time = tuner->elapsed;
+        tuner->extremum = temperature;
+        tuner->extremum_time = tuner->elapsed;
+    }
+
+    /* Heating half-cycles end in a minimum, cooling half-cycles in a maximum. */
+    if ((tuner->relay_high && temperature < tuner->extremum) ||
+        (!tuner->relay_high && temperature > tuner->extremum))
+    {
+        tuner->extremum = temperature;
+        tuner->extremum_time = tuner->elapsed;
+    }
+
+    if (tuner->relay_high && temperature > tuner->config.setpoint + tuner->config.hysteresis)
+    {
+        finish_half_cycle(tuner, temperature);
+        tuner->relay_high = false;
+    }
+    else if (!tuner->relay_high && temperature < tuner->config.setpoint - tuner->config.hysteresis)
+    {
+        finish_half_cycle(tuner, temperature);
+        tuner->relay_high = true;
+
+        if (tuner->half_cycles > DISCARDED_HALF_CYCLES + 1 && tuner->last_rising_switch_time > 0.0f)
+        {
+            tuner->period_sum += tuner->elapsed - tuner->last_rising_switch_time;
+            tuner->high_time_sum += tuner->cycle_high_time;
+            tuner->cycles_measured++;
+        }
+
+        tuner->last_rising_switch_time = tuner->elapsed;
+        tuner->cycle_high_time = 0.0f;
+    }
+
+    if (tuner->cycles_measured >= tuner->config.cycles && tuner->max_count > 0 && tuner->min_count > 0)
+    {
+        identify(tuner);
+    }
+
+    if (tuner->state != AUTOTUNE_STATE_RUNNING)
+    {
+        return tuner->config.output_low;
+    }
+
+    return tuner->relay_high ? tuner->config.output_high : tuner->config.output_low;
+}
+
+autotune_state_t autotune_get_state(const autotune_t *tuner)
+{
+    return tuner->state;
+}
+
+bool autotune_get_result(const autotune_t *tuner, autotune_result_t *result)
+{
+    if (tuner->state != AUTOTUNE_STATE_DONE || result == NULL)
+    {
+        return false;
+    }
+
+    *result = tuner->result;
+
+    return true;
+}
+
+bool autotune_apply_rule(autotune_rule_t rule, autotune_result_t *result)
+{
+    float ku = result->ultimate_gain;
+    float pu = result->ultimate_period;
+    float kc;
+    float ti;
+    float td;
+
+    switch (rule)
+    {
+        case AUTOTUNE_RULE_ZIEGLER_NICHOLS:
+            kc = 0.6f * ku;
+            ti = 0.5f * pu;
+            td = 0.125f * pu;
+            break;
+
+        case AUTOTUNE_RULE_TYREUS_LUYBEN:
+            kc = ku / 2.2f;
+            ti = 2.2f * pu;
+            td = pu / 6.3f;
+            break;
+
+        case AUTOTUNE_RULE_SIMC:
+        {
+            /* PI tuning with the closed loop time constant equal to the dead time. */
+            float theta = result->dead_time;
+            float tau_c = theta;
+
+            if (result->integrating_gain <= 0.0f || theta <= 0.0f)
+            {
+                return false;
+            }
+
+            if (result->process_gain > 0.0f && result->time_constant < 8.0f * theta)
+            {
+                kc = result->time_constant / (result->process_gain * (tau_c + theta));
+                ti = fminf(result->time_constant, 4.0f * (tau_c + theta));
+            }
+            else
+            {
+                kc = 1.0f / (result->integrating_gain * (tau_c + theta));
+                ti = 4.0f * (tau_c + theta);
+            }
+
+            td = 0.0f;
+            break;
+        }
+
+        default:
+            return false;
+    }
+
+    if (kc <= 0.0f || ti <= 0.0f)
+    {
+        return false;
+    }
+
+    result->kp = kc;
+    result->ki = kc / ti;
+    result->kd = kc * td;
+
+    return true;
+}
+
+static void finish_half_cycle(autotune_t *tuner, float temperature)
+{
+    tuner->half_cycles++;
+
+    if (tuner->half_cycles > DISCARDED_HALF_CYCLES)
+    {
+        float slope_time = tuner->elapsed - tuner->extremum_time;
+        float slope = (slope_time > 0.0f) ? (temperature - tuner->extremum) / slope_time : 0.0f;
+
+        if (tuner->relay_high)
+        {
+            tuner->min_sum += tuner->extremum;
+            tuner->min_count++;
+            tuner->rise_slope_sum += slope;
+            tuner->rise_slope_count++;
+        }
+        else
+        {
+            tuner->max_sum += tuner->extremum;
+            tuner->max_count++;
+            tuner->fall_slope_sum += slope;
+            tuner->fall_slope_count++;
+        }
+
+        tuner->dead_time_sum += tuner->extremum_time - tuner->half_start_time;
+        tuner->dead_time_count++;
+    }
+
+    tuner->half_start_time = tuner->elapsed;
+    tuner->extremum = tuner->relay_high ? -INFINITY : INFINITY;
+    tuner->extremum_time = tuner->elapsed;
+}
+
+static void identify(autotune_t *tuner)
+{
+    autotune_result_t *result = &tuner->result;
+
+    float average_max = tuner->max_sum / tuner->max_count;
+    float average_min = tuner->min_sum / tuner->min_count;
+    float amplitude = 0.5f * (average_max - average_min);
+    float relay_amplitude = 0.5f * (tuner->config.output_high - tuner->config.output_low);
+    float hysteresis = tuner->config.hysteresis;
+    float period = tuner->period_sum / tuner->cycles_measured;
+
+    if (amplitude <= 0.0f || period <= 0.0f)
+    {
+        tuner->state = AUTOTUNE_STATE_FAILED;
+        return;
+    }
+
+    float effective_amplitude = (amplitude > hysteresis) ? sqrtf(amplitude * amplitude - hysteresis * hysteresis) : amplitude;
+
+    result->amplitude = amplitude;
+    result->mean_output = tuner->config.output_low + (tuner->config.output_high - tuner->config.output_low) * tuner->high_time_sum / tuner->period_sum;
+    result->ultimate_period = period;
+    result->ultimate_gain = 4.0f * relay_amplitude / (PI_F * effective_amplitude);
+
+    float omega = 2.0f * PI_F / period;
+    float rise_slope = tuner->rise_slope_sum / tuner->rise_slope_count;
+    float fall_slope = tuner->fall_slope_sum / tuner->fall_slope_count;
+    float integrating_gain = (rise_slope - fall_slope) / (tuner->config.output_high - tuner->config.output_low);
+
+    result->dead_time = tuner->dead_time_sum / tuner->dead_time_count;
+    result->integrating_gain = integrating_gain;
+    result->process_gain = 0.0f;
+    result->time_constant = 0.0f;
+
+    /* |G(jw)| = 1/Ku with K = k' * tau; solvable only when the lag does not dominate. */
+    float magnitude_term = integrating_gain * integrating_gain * result->ultimate_gain * result->ultimate_gain - omega * omega;
+
+    if (magnitude_term > 0.0f)
+    {
+        result->time_constant = 1.0f / sqrtf(magnitude_term);
+        result->process_gain = integrating_gain * result->time_constant;
+    }
+
+    if (!autotune_apply_rule(tuner->config.rule, result))
+    {
+        tuner->state = AUTOTUNE_STATE_FAILED;
+        return;
+    }
+
+    tuner->state = AUTOTUNE_STATE_DONE;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum
+{
+    AUTOTUNE_RULE_ZIEGLER_NICHOLS,
+    AUTOTUNE_RULE_TYREUS_LUYBEN,
+    AUTOTUNE_RULE_SIMC,
+
+    AUTOTUNE_RULE_NUMBER,
+} autotune_rule_t;
+
+typedef enum
+{
+    AUTOTUNE_STATE_IDLE,
+    AUTOTUNE_STATE_RUNNING,
+    AUTOTUNE_STATE_DONE,
+    AUTOTUNE_STATE_FAILED,
+
+    AUTOTUNE_STATE_NUMBER,
+} autotune_state_t;
+
+typedef struct
+{
+    float setpoint;
+    float output_high;
+    float output_low;
+    float hysteresis;
+    uint8_t cycles;
+    float timeout_s;
+    autotune_rule_t rule;
+} autotune_config_t;
+
+typedef struct
+{
+    float ultimate_gain;
+    float ultimate_period;
+    float amplitude;
+    float mean_output; /* relay output averaged over the measured cycles */
+
+    float integrating_gain;
+    float process_gain;
+    float time_constant;
+    float dead_time;
+
+    float kp;
+    float ki;
+    float kd;
+} autotune_result_t;
+
+typedef struct
+{
+    autotune_config_t config;
+    autotune_state_t state;
+    autotune_result_t result;
+
+    bool relay_high;
+    bool started;
+    float elapsed;
+    float half_start_time;
+    float last_rising_switch_time;
+    float cycle_high_time;
+    float extremum;
+    float extremum_time;
+
+    uint8_t half_cycles;
+    uint8_t cycles_measured;
+    float max_sum;
+    float min_sum;
+    float period_sum;
+    float high_time_sum;
+    float dead_time_sum;
+    float rise_slope_sum;
+    float fall_slope_sum;
+    uint8_t max_count;
+    uint8_t min_count;
+    uint8_t dead_time_count;
+    uint8_t rise_slope_count;
+    uint8_t fall_slope_count;
+} autotune_t;
+
+void autotune_start(autotune_t *tuner, const autotune_config_t *config);
+void autotune_stop(autotune_t *tuner);
+float autotune_update(autotune_t *tuner, float temperature, float dt);
+autotune_state_t autotune_get_state(const autotune_t *tuner);
+bool autotune_get_result(const autotune_t *tuner, autotune_result_t *result);
+bool autotune_apply_rule(autotune_rule_t rule, autotune_result_t *result);
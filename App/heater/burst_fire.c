@@ -0,0 +1,91 @@
+/**
+ * Burst-fire scheduler for zero-crossing SSRs
+ *
+ * Each output's duty is quantised to a number of conducting half-cycles per
+ * window and spread over the window with a Bresenham accumulator, so a 37 %
+ * duty fires 37 of 100 half-cycles as evenly as possible. The accumulators
+ * start staggered so outputs do not line up, and at most max_simultaneous
+ * outputs conduct in the same half-cycle; a deferred half-cycle is fired
+ * later, with the first pick rotating between outputs.
+ */
+
+#include "burst_fire.h"
+
+#include <math.h>
+#include <stddef.h>
+
+bool burst_fire_init(burst_fire_t *burst, uint8_t output_count, uint16_t window_half_cycles, uint8_t max_simultaneous)
+{
+    if (output_count == 0 || output_count > BURST_FIRE_MAX_OUTPUTS || window_half_cycles == 0)
+    {
+        return false;
+    }
+
+    burst->output_count = output_count;
+    burst->window = window_half_cycles;
+    burst->max_simultaneous = max_simultaneous;
+    burst->priority = 0;
+
+    for (uint8_t i = 0; i < output_count; i++)
+    {
+        burst->level[i] = 0;
+        burst->accumulator[i] = (int32_t)i * window_half_cycles / output_count;
+    }
+
+    return true;
+}
+
+void burst_fire_set_duty(burst_fire_t *burst, uint8_t output, float duty_percent)
+{
+    if (output >= burst->output_count)
+    {
+        return;
+    }
+
+    if (!(duty_percent > 0.0f)) duty_percent = 0.0f;
+    if (duty_percent > 100.0f) duty_percent = 100.0f;
+
+    burst->level[output] = (uint16_t)lroundf(duty_percent * burst->window / 100.0f);
+}
+
+void burst_fire_set_max_simultaneous(burst_fire_t *burst, uint8_t max_simultaneous)
+{
+    burst->max_simultaneous = max_simultaneous;
+}
+
+/* Returns a bit mask of the outputs that conduct during the coming half-cycle. */
+uint32_t burst_fire_next_half_cycle(burst_fire_t *burst)
+{
+    uint32_t mask = 0;
+    uint8_t fired = 0;
+
+    for (uint8_t k = 0; k < burst->output_count; k++)
+    {
+        uint8_t i = (burst->priority + k) % burst->output_count;
+
+        if (burst->level[i] == 0)
+        {
+            burst->accumulator[i] = 0;
+            continue;
+        }
+
+        burst->accumulator[i] += burst->level[i];
+
+        if (burst->accumulator[i] >= burst->window && fired < burst->max_simultaneous)
+        {
+            burst->accumulator[i] -= burst->window;
+            mask |= (1u << i);
+            fired++;
+        }
+
+        /* Bound the backlog of deferred half-cycles when demand exceeds the cap. */
+        if (burst->accumulator[i] > 2 * burst->window)
+        {
+            burst->accumulator[i] = 2 * burst->window;
+        }
+    }
+
+    burst->priority = (burst->priority + 1) % burst->output_count;
+
+    return mask;
+}
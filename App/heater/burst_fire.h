@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BURST_FIRE_MAX_OUTPUTS 4
+
+typedef struct
+{
+    uint8_t output_count;
+    uint16_t window;
+    uint8_t max_simultaneous;
+    uint8_t priority;
+    uint16_t level[BURST_FIRE_MAX_OUTPUTS];
+    int32_t accumulator[BURST_FIRE_MAX_OUTPUTS];
+} burst_fire_t;
+
+bool burst_fire_init(burst_fire_t *burst, uint8_t output_count, uint16_t window_half_cycles, uint8_t max_simultaneous);
+void burst_fire_set_duty(burst_fire_t *burst, uint8_t output, float duty_percent);
+void burst_fire_set_max_simultaneous(burst_fire_t *burst, uint8_t max_simultaneous);
+uint32_t burst_fire_next_half_cycle(burst_fire_t *burst);
@@ -0,0 +1,64 @@
+/**
+ * Closed-loop response metrics: settling time, overshoot, IAE, ISE and
+ * actuator switching count, measured from the last reset
+ */
+
+#include "control_metrics.h"
+
+#include <math.h>
+
+void control_metrics_reset(control_metrics_t *metrics, float setpoint, float temperature, float settling_band)
+{
+    metrics->settling_band = settling_band;
+    metrics->direction = (setpoint >= temperature) ? 1.0f : -1.0f;
+
+    metrics->elapsed = 0.0f;
+    metrics->settling_time = 0.0f;
+    metrics->overshoot = 0.0f;
+    metrics->iae = 0.0f;
+    metrics->ise = 0.0f;
+
+    metrics->switch_count = 0;
+}
+
+void control_metrics_update(control_metrics_t *metrics, float setpoint, float temperature, float dt)
+{
+    if (isnan(temperature))
+    {
+        return;
+    }
+
+    float error = setpoint - temperature;
+    float overshoot = -error * metrics->direction;
+
+    metrics->elapsed += dt;
+    metrics->iae += fabsf(error) * dt;
+    metrics->ise += error * error * dt;
+
+    if (overshoot > metrics->overshoot)
+    {
+        metrics->overshoot = overshoot;
+    }
+
+    /* Settling time is the last moment the error was outside the band. */
+    if (fabsf(error) > metrics->settling_band)
+    {
+        metrics->settling_time = metrics->elapsed;
+    }
+}
+
+void control_metrics_record_output(control_metrics_t *metrics, bool output_on)
+{
+    if (output_on && !metrics->output_on)
+    {
+        metrics->switch_count++;
+    }
+
+    metrics->output_on = output_on;
+}
+
+/* For outputs switched outside the control loop, which count their own off-to-on edges. */
+void control_metrics_add_switches(control_metrics_t *metrics, uint32_t switch_count)
+{
+    metrics->switch_count += switch_count;
+}
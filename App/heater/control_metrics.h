@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+    float settling_band;
+    float direction;
+
+    float elapsed;
+    float settling_time;
+    float overshoot;
+    float iae;
+    float ise;
+
+    bool output_on;
+    uint32_t switch_count;
+} control_metrics_t;
+
+void control_metrics_reset(control_metrics_t *metrics, float setpoint, float temperature, float settling_band);
+void control_metrics_update(control_metrics_t *metrics, float setpoint, float temperature, float dt);
+void control_metrics_record_output(control_metrics_t *metrics, bool output_on);
+void control_metrics_add_switches(control_metrics_t *metrics, uint32_t switch_count);
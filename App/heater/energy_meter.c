@@ -0,0 +1,93 @@
+/**
+ * Heater energy accounting
+ *
+ * Integrates the measured on-time of one heater output into energy at the
+ * configured heater power, and keeps on-time, switch counts and energy for
+ * the whole run, for each of the last ENERGY_METER_HOURS hours and for the
+ * running and the last finished setpoint program.
+ */
+
+#include "energy_meter.h"
+
+#include <string.h>
+
+static void add_to_period(energy_period_t *period, uint32_t on_time_ms, uint32_t elapsed_ms, uint32_t switch_count, double energy_wh);
+
+void energy_meter_init(energy_meter_t *meter, float heater_power)
+{
+    memset(meter, 0, sizeof(*meter));
+    meter->heater_power = (heater_power > 0.0f) ? heater_power : 0.0f;
+}
+
+/* Takes effect for on-time recorded from now on, past energy is kept. */
+void energy_meter_set_heater_power(energy_meter_t *meter, float heater_power)
+{
+    meter->heater_power = (heater_power > 0.0f) ? heater_power : 0.0f;
+}
+
+/* Adds the on-time, wall time and switch count accumulated since the previous call. */
+void energy_meter_update(energy_meter_t *meter, uint32_t on_time_ms, uint32_t elapsed_ms, uint32_t switch_count)
+{
+    double energy_wh = (double)meter->heater_power * on_time_ms / ENERGY_METER_HOUR_MS;
+
+    add_to_period(&meter->total, on_time_ms, elapsed_ms, switch_count, energy_wh);
+    add_to_period(&meter->current_hour, on_time_ms, elapsed_ms, switch_count, energy_wh);
+
+    if (meter->program_running)
+    {
+        add_to_period(&meter->program, on_time_ms, elapsed_ms, switch_count, energy_wh);
+    }
+
+    if (meter->current_hour.elapsed_ms >= ENERGY_METER_HOUR_MS)
+    {
+        meter->hours[meter->hour_head] = meter->current_hour;
+        meter->hour_head = (meter->hour_head + 1) % ENERGY_METER_HOURS;
+        if (meter->hour_count < ENERGY_METER_HOURS)
+        {
+            meter->hour_count++;
+        }
+
+        memset(&meter->current_hour, 0, sizeof(meter->current_hour));
+    }
+}
+
+void energy_meter_program_start(energy_meter_t *meter)
+{
+    memset(&meter->program, 0, sizeof(meter->program));
+    meter->program_running = true;
+}
+
+void energy_meter_program_stop(energy_meter_t *meter)
+{
+    if (meter->program_running)
+    {
+        meter->last_program = meter->program;
+        meter->program_running = false;
+    }
+}
+
+/* hours_ago = 0 is the last completed hour. */
+bool energy_meter_get_hour(const energy_meter_t *meter, uint8_t hours_ago, energy_period_t *hour)
+{
+    if (hours_ago >= meter->hour_count)
+    {
+        return false;
+    }
+
+    *hour = meter->hours[(meter->hour_head + ENERGY_METER_HOURS - 1 - hours_ago) % ENERGY_METER_HOURS];
+
+    return true;
+}
+
+float energy_meter_duty(const energy_period_t *period)
+{
+    return (period->elapsed_ms > 0) ? 100.0f * (float)period->on_time_ms / (float)period->elapsed_ms : 0.0f;
+}
+
+static void add_to_period(energy_period_t *period, uint32_t on_time_ms, uint32_t elapsed_ms, uint32_t switch_count, double energy_wh)
+{
+    period->on_time_ms += on_time_ms;
+    period->elapsed_ms += elapsed_ms;
+    period->switch_count += switch_count;
+    period->energy_wh += energy_wh;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ENERGY_METER_HOURS 24
+#define ENERGY_METER_HOUR_MS 3600000u
+
+typedef struct
+{
+    uint64_t on_time_ms;
+    uint64_t elapsed_ms;
+    uint32_t switch_count;
+    double energy_wh;
+} energy_period_t;
+
+typedef struct
+{
+    float heater_power;
+
+    energy_period_t total;
+
+    energy_period_t current_hour;
+    energy_period_t hours[ENERGY_METER_HOURS];
+    uint8_t hour_head;
+    uint8_t hour_count;
+
+    bool program_running;
+    energy_period_t program;
+    energy_period_t last_program;
+} energy_meter_t;
+
+void energy_meter_init(energy_meter_t *meter, float heater_power);
+void energy_meter_set_heater_power(energy_meter_t *meter, float heater_power);
+void energy_meter_update(energy_meter_t *meter, uint32_t on_time_ms, uint32_t elapsed_ms, uint32_t switch_count);
+void energy_meter_program_start(energy_meter_t *meter);
+void energy_meter_program_stop(energy_meter_t *meter);
+bool energy_meter_get_hour(const energy_meter_t *meter, uint8_t hours_ago, energy_period_t *hour);
+float energy_meter_duty(const energy_period_t *period);
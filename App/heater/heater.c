@@ -2,77 +2,167 @@
 #include "cmsis_os.h"
 #include "main.h"
 #include <math.h>
+#include <string.h>
 
 #include "temperature_sensor.h"
+#include "heater_output.h"
+#include "loop_profiler.h"
+#include "retention.h"
+#include "stack_monitor.h"
+#include "data_bus.h"
 
-#define KP 15.0f
-#define KI 0.4f
-#define KD 0.4f
-
-#define DEFAULT_SETPOINT 50.0f
 #define CYCLE_TIME_MS 1000
-#define MIN_HEATER_TIME_MS 20
+#define MIN_CYCLE_TIME_MS 50
+#define MAX_CYCLE_TIME_MS 5000
+#define COMMAND_QUEUE_LENGTH 8
+#define PID_TASK_STACK_SIZE (256 * 4)
+#define MAX_POWER_CAP (100.0f * HEATER_ZONE_NUMBER)
+#define DEFAULT_HEATER_POWER_W 250.0f
+#define DEFAULT_OUTPUT_MODE HEATER_OUTPUT_MODE_SLOW_PWM
+#define MAX_SIMULTANEOUS_OUTPUTS HEATER_OUTPUT_NUMBER
 #define TEMPERATURE_TOLERANCE 0.0f //off
 #define STIMULATION_TOLERANCE 0.0f //off
+#define RETAINED_MAGIC 0x48545231u
+#define PID_FLAG_SAMPLE 0x01u
+#define SAMPLE_WAIT_CYCLE_FRACTION 8
 
 typedef struct
 {
-    float kp;
-    float ki;
-    float kd;
-
-    float setpoint;
-    float integral;
-    float previous_error;
-    float previous_temperature;
-    float current_power;
-} pid_parameters_t;
+    temperature_sensor_channel_t sensor_channel;
+    heater_output_channel_t output_channel;
+    heater_mode_t initial_mode;
+} heater_zone_config_t;
 
-typedef enum
+typedef struct
 {
-    HEATER_MODE_OFF,
-    HEATER_MODE_ON,
-    HEATER_MODE_KEEP,
-
-    HEATER_MODE_NUMBER,
-} heater_mode_t;
+    heater_control_t control;
+    bool heater_state;
+    bool coupled;
+    float setpoint_offset;
+    float temperature;
+    float sample_age;
+    rtc_timestamp_t sample_timestamp;
+    float output;
+    float dt;
+    TickType_t last_sample_tick;
+    heater_status_t status;
+
+    energy_meter_t energy;
+    heater_output_counters_t counters;
+    TickType_t energy_tick;
+
+    setpoint_segment_t program_segments[SETPOINT_PROGRAM_MAX_SEGMENTS];
+    bool program_queued;
+} heater_zone_handler_t;
 
 typedef struct
 {
-    pid_parameters_t pid_params;
-    bool heater_state;
-    heater_mode_t mode;
+    heater_zone_handler_t zones[HEATER_ZONE_NUMBER];
+    uint32_t cycle_time_ms;
+    float power_cap;
+    loop_profiler_t profiler;
     osThreadId_t task_handle;
     osMutexId_t mutex;
+    osMessageQueueId_t command_queue;
 } pid_handler_t;
 
-pid_handler_t pid_handler =
+/* Zones are serviced in this order every cycle; the master zone comes first. */
+static const heater_zone_config_t zone_config[HEATER_ZONE_NUMBER] =
+{
+    [HEATER_ZONE_TOP] = { TEMPERATURE_SENSOR_CHANNEL_CHAMBER, HEATER_OUTPUT_1, HEATER_MODE_KEEP },
+    [HEATER_ZONE_BOTTOM] = { TEMPERATURE_SENSOR_CHANNEL_PROBE, HEATER_OUTPUT_2, HEATER_MODE_OFF },
+};
+
+typedef struct
 {
-    .pid_params.kp = KP,
-    .pid_params.ki = KI,
-    .pid_params.kd = KD,
+    heater_control_retained_t control;
+    bool coupled;
+    float setpoint_offset;
+} heater_zone_retained_t;
 
-    .pid_params.setpoint = DEFAULT_SETPOINT,
-    .pid_params.integral = 0.0f,
-    .pid_params.previous_error = 0.0f,
-    .pid_params.current_power = 0.0f,
-    .pid_params.previous_temperature = 0.0f,
+typedef struct
+{
+    retention_header_t header;
+    heater_zone_retained_t zones[HEATER_ZONE_NUMBER];
+} heater_retained_t;
 
-    .heater_state = false,
-    .mode = HEATER_MODE_OFF,
+pid_handler_t pid_handler =
+{
+    .cycle_time_ms = CYCLE_TIME_MS,
+    .power_cap = MAX_POWER_CAP,
 };
 
+/* Rewritten every cycle so a warm reset resumes from the last cycle's state. */
+static heater_retained_t heater_retained RETAINED;
+
+static StaticTask_t pid_task_control_block;
+static StackType_t pid_task_stack[PID_TASK_STACK_SIZE / sizeof(StackType_t)];
+static StaticSemaphore_t pid_mutex_control_block;
+static StaticQueue_t command_queue_control_block;
+static uint8_t command_queue_storage[COMMAND_QUEUE_LENGTH * sizeof(heater_command_t)];
+
 static void pid_task(void *argument);
-static void apply_pid_output(float pid_output);
-static float calculate_pid_output(float current_temperature);
+static void wait_for_sample(void);
+static void publish_status(void);
+static bool restore_state(void);
+static void retain_state(void);
+static void update_zone(heater_zone_t zone, TickType_t sample_tick);
+static void apply_power_cap(void);
+static void apply_pid_output(heater_zone_t zone, float pid_output);
+static void account_energy(heater_zone_t zone, TickType_t now);
+static bool validate_command(const heater_command_t *command);
+static bool send_program_start(const heater_command_t *command);
+static void process_commands(void);
+static void apply_command(const heater_command_t *command);
 
 bool heater_init(void)
 {
     bool mutex_ok = false;
     bool task_ok = false;
+    bool output_ok = heater_output_init() && heater_output_set_mode(DEFAULT_OUTPUT_MODE);
+    bool profiler_ok = loop_profiler_init(&pid_handler.profiler, pid_handler.cycle_time_ms * 1000, LOOP_PROFILER_DEFAULT_BIN_US);
+
+    heater_output_set_max_simultaneous(MAX_SIMULTANEOUS_OUTPUTS);
+
+    for (heater_zone_t zone = 0; zone < HEATER_ZONE_NUMBER; zone++)
+    {
+        heater_zone_handler_t *handler = &pid_handler.zones[zone];
+
+        heater_control_init(&handler->control);
+        heater_control_set_mode(&handler->control, zone_config[zone].initial_mode);
+        handler->heater_state = false;
+        handler->coupled = false;
+        handler->setpoint_offset = 0.0f;
+        handler->temperature = NAN;
+        handler->sample_age = 0.0f;
+        handler->sample_timestamp = 0;
+        handler->output = 0.0f;
+        handler->dt = CYCLE_TIME_MS / 1000.0f;
+        handler->program_queued = false;
+        heater_control_get_status(&handler->control, NAN, &handler->status);
+        energy_meter_init(&handler->energy, DEFAULT_HEATER_POWER_W);
+    }
+
+    restore_state();
+    publish_status();
 
-    pid_handler.mutex = osMutexNew(NULL);
-    if (pid_handler.mutex != NULL)
+    const osMutexAttr_t mutex_attributes =
+    {
+        .cb_mem = &pid_mutex_control_block,
+        .cb_size = sizeof(pid_mutex_control_block)
+    };
+
+    const osMessageQueueAttr_t queue_attributes =
+    {
+        .cb_mem = &command_queue_control_block,
+        .cb_size = sizeof(command_queue_control_block),
+        .mq_mem = command_queue_storage,
+        .mq_size = sizeof(command_queue_storage)
+    };
+
+    pid_handler.mutex = osMutexNew(&mutex_attributes);
+    pid_handler.command_queue = osMessageQueueNew(COMMAND_QUEUE_LENGTH, sizeof(heater_command_t), &queue_attributes);
+    if (pid_handler.mutex != NULL && pid_handler.command_queue != NULL)
     {
         mutex_ok = true;
 
@@ -80,104 +170,747 @@ bool heater_init(void)
         {
             .name = "PIDTask",
             .priority = osPriorityAboveNormal,
-            .stack_size = 256 * 4
+            .cb_mem = &pid_task_control_block,
+            .cb_size = sizeof(pid_task_control_block),
+            .stack_mem = pid_task_stack,
+            .stack_size = sizeof(pid_task_stack)
         };
 
         pid_handler.task_handle = osThreadNew(pid_task, NULL, &task_attributes);
-        task_ok = (pid_handler.task_handle != NULL);
+        task_ok = (pid_handler.task_handle != NULL) && stack_monitor_register(pid_handler.task_handle, sizeof(pid_task_stack)) &&
+                  data_bus_subscribe(DATA_BUS_TOPIC_TEMPERATURE, pid_handler.task_handle, PID_FLAG_SAMPLE);
+    }
+
+    return output_ok && profiler_ok && mutex_ok && task_ok;
+}
+
+bool heater_set_cycle_time(uint32_t cycle_time_ms)
+{
+    if (cycle_time_ms < MIN_CYCLE_TIME_MS || cycle_time_ms > MAX_CYCLE_TIME_MS)
+    {
+        return false;
     }
 
-    return mutex_ok && task_ok;
+    if (osMutexAcquire(pid_handler.mutex, osWaitForever) != osOK)
+    {
+        return false;
+    }
+
+    pid_handler.cycle_time_ms = cycle_time_ms;
+
+    return osMutexRelease(pid_handler.mutex) == osOK;
+}
+
+uint32_t heater_get_cycle_time(void)
+{
+    return pid_handler.cycle_time_ms;
+}
+
+bool heater_autotune_start(heater_zone_t zone, autotune_rule_t rule)
+{
+    const heater_command_t command = { .type = HEATER_COMMAND_AUTOTUNE_START, .zone = zone, .rule = rule };
+    return heater_send_command(&command);
+}
+
+void heater_autotune_stop(heater_zone_t zone)
+{
+    const heater_command_t command = { .type = HEATER_COMMAND_AUTOTUNE_STOP, .zone = zone };
+    heater_send_command(&command);
+}
+
+autotune_state_t heater_autotune_get_state(heater_zone_t zone)
+{
+    heater_status_t status;
+    heater_get_status(zone, &status);
+    return status.autotune_state;
+}
+
+bool heater_autotune_get_result(heater_zone_t zone, autotune_result_t *result)
+{
+    bool result_ok = false;
+
+    if (zone < HEATER_ZONE_NUMBER && osMutexAcquire(pid_handler.mutex, osWaitForever) == osOK)
+    {
+        result_ok = autotune_get_result(&pid_handler.zones[zone].control.autotune, result);
+        osMutexRelease(pid_handler.mutex);
+    }
+
+    return result_ok;
+}
+
+bool heater_program_start(heater_zone_t zone, const setpoint_segment_t *segments, uint8_t segment_count)
+{
+    const heater_command_t command = { .type = HEATER_COMMAND_PROGRAM_START, .zone = zone, .segments = segments, .segment_count = segment_count };
+    return heater_send_command(&command);
+}
+
+void heater_program_stop(heater_zone_t zone)
+{
+    const heater_command_t command = { .type = HEATER_COMMAND_PROGRAM_STOP, .zone = zone };
+    heater_send_command(&command);
+}
+
+bool heater_program_is_running(heater_zone_t zone)
+{
+    heater_status_t status;
+    heater_get_status(zone, &status);
+    return status.program_running;
+}
+
+bool heater_get_metrics(heater_zone_t zone, control_metrics_t *metrics)
+{
+    if (zone >= HEATER_ZONE_NUMBER || osMutexAcquire(pid_handler.mutex, osWaitForever) != osOK)
+    {
+        return false;
+    }
+
+    *metrics = pid_handler.zones[zone].control.metrics;
+
+    return osMutexRelease(pid_handler.mutex) == osOK;
+}
+
+bool heater_set_gain_schedule(heater_zone_t zone, const pid_gain_set_t *table, uint8_t count, pid_schedule_source_t source)
+{
+    bool schedule_ok = false;
+
+    if (zone < HEATER_ZONE_NUMBER && osMutexAcquire(pid_handler.mutex, osWaitForever) == osOK)
+    {
+        schedule_ok = heater_control_set_gain_schedule(&pid_handler.zones[zone].control, table, count, source);
+        osMutexRelease(pid_handler.mutex);
+    }
+
+    return schedule_ok;
+}
+
+bool heater_set_controller(heater_zone_t zone, heater_controller_t controller)
+{
+    const heater_command_t command = { .type = HEATER_COMMAND_SET_CONTROLLER, .zone = zone, .controller = controller };
+    return heater_send_command(&command);
+}
+
+heater_controller_t heater_get_controller(heater_zone_t zone)
+{
+    heater_status_t status;
+    heater_get_status(zone, &status);
+    return status.controller;
+}
+
+bool heater_set_model(heater_zone_t zone, const fopdt_model_t *model, float closed_loop_time)
+{
+    bool model_ok = false;
+
+    if (zone < HEATER_ZONE_NUMBER && osMutexAcquire(pid_handler.mutex, osWaitForever) == osOK)
+    {
+        model_ok = heater_control_set_model(&pid_handler.zones[zone].control, model, closed_loop_time);
+        osMutexRelease(pid_handler.mutex);
+    }
+
+    return model_ok;
+}
+
+bool heater_get_model(heater_zone_t zone, fopdt_model_t *model)
+{
+    bool model_ok = false;
+
+    if (zone < HEATER_ZONE_NUMBER && osMutexAcquire(pid_handler.mutex, osWaitForever) == osOK)
+    {
+        model_ok = pid_handler.zones[zone].control.smith.valid;
+        if (model_ok)
+        {
+            *model = pid_handler.zones[zone].control.smith.model;
+        }
+        osMutexRelease(pid_handler.mutex);
+    }
+
+    return model_ok;
+}
+
+float heater_get_setpoint(heater_zone_t zone)
+{
+    heater_status_t status;
+    heater_get_status(zone, &status);
+    return status.setpoint;
+}
+
+bool heater_set_mode(heater_zone_t zone, heater_mode_t mode)
+{
+    const heater_command_t command = { .type = HEATER_COMMAND_SET_MODE, .zone = zone, .mode = mode };
+    return heater_send_command(&command);
+}
+
+bool heater_set_setpoint(heater_zone_t zone, float setpoint)
+{
+    const heater_command_t command = { .type = HEATER_COMMAND_SET_SETPOINT, .zone = zone, .setpoint = setpoint };
+    return heater_send_command(&command);
+}
+
+bool heater_set_gains(heater_zone_t zone, float kp, float ki, float kd)
+{
+    const heater_command_t command = { .type = HEATER_COMMAND_SET_GAINS, .zone = zone, .kp = kp, .ki = ki, .kd = kd };
+    return heater_send_command(&command);
+}
+
+bool heater_set_coupling(heater_zone_t zone, bool coupled, float setpoint_offset)
+{
+    const heater_command_t command = { .type = HEATER_COMMAND_SET_COUPLING, .zone = zone, .coupled = coupled, .setpoint_offset = setpoint_offset };
+    return heater_send_command(&command);
+}
+
+bool heater_clear_fault(heater_zone_t zone)
+{
+    const heater_command_t command = { .type = HEATER_COMMAND_CLEAR_FAULT, .zone = zone };
+    return heater_send_command(&command);
+}
+
+thermal_fault_t heater_get_fault(heater_zone_t zone)
+{
+    heater_status_t status;
+    heater_get_status(zone, &status);
+    return status.fault;
+}
+
+bool heater_set_power_cap(float total_percent)
+{
+    const heater_command_t command = { .type = HEATER_COMMAND_SET_POWER_CAP, .power_cap = total_percent };
+    return heater_send_command(&command);
+}
+
+float heater_get_power_cap(void)
+{
+    return pid_handler.power_cap;
+}
+
+/* The output stage drives every zone from one timer, so the mode applies to all of them. */
+bool heater_set_output_mode(heater_output_mode_t mode)
+{
+    const heater_command_t command = { .type = HEATER_COMMAND_SET_OUTPUT_MODE, .output_mode = mode };
+    return heater_send_command(&command);
+}
+
+heater_output_mode_t heater_get_output_mode(void)
+{
+    return heater_output_get_mode();
+}
+
+bool heater_set_heater_power(heater_zone_t zone, float watts)
+{
+    if (zone >= HEATER_ZONE_NUMBER || !(watts >= 0.0f) || osMutexAcquire(pid_handler.mutex, osWaitForever) != osOK)
+    {
+        return false;
+    }
+
+    energy_meter_set_heater_power(&pid_handler.zones[zone].energy, watts);
+
+    return osMutexRelease(pid_handler.mutex) == osOK;
+}
+
+bool heater_get_energy(heater_zone_t zone, energy_meter_t *energy)
+{
+    if (zone >= HEATER_ZONE_NUMBER || osMutexAcquire(pid_handler.mutex, osWaitForever) != osOK)
+    {
+        return false;
+    }
+
+    *energy = pid_handler.zones[zone].energy;
+
+    return osMutexRelease(pid_handler.mutex) == osOK;
+}
+
+bool heater_reset_energy(heater_zone_t zone)
+{
+    if (zone >= HEATER_ZONE_NUMBER || osMutexAcquire(pid_handler.mutex, osWaitForever) != osOK)
+    {
+        return false;
+    }
+
+    energy_meter_t *energy = &pid_handler.zones[zone].energy;
+    energy_meter_init(energy, energy->heater_power);
+
+    return osMutexRelease(pid_handler.mutex) == osOK;
+}
+
+bool heater_send_command(const heater_command_t *command)
+{
+    if (command == NULL || !validate_command(command))
+    {
+        return false;
+    }
+
+    if (command->type == HEATER_COMMAND_PROGRAM_START)
+    {
+        return send_program_start(command);
+    }
+
+    return osMessageQueuePut(pid_handler.command_queue, command, 0, 0) == osOK;
+}
+
+/*
+ * The caller's table need not outlive the call, so it is copied to the zone
+ * and the queued command points there. Each zone has one copy, so a second
+ * start is refused until the PID task has taken the first.
+ */
+static bool send_program_start(const heater_command_t *command)
+{
+    heater_zone_handler_t *handler = &pid_handler.zones[command->zone];
+    heater_command_t queued = *command;
+    bool sent = false;
+
+    if (osMutexAcquire(pid_handler.mutex, osWaitForever) != osOK)
+    {
+        return false;
+    }
+
+    if (!handler->program_queued)
+    {
+        memcpy(handler->program_segments, command->segments, command->segment_count * sizeof(setpoint_segment_t));
+        queued.segments = handler->program_segments;
+
+        sent = osMessageQueuePut(pid_handler.command_queue, &queued, 0, 0) == osOK;
+        handler->program_queued = sent;
+    }
+
+    osMutexRelease(pid_handler.mutex);
+
+    return sent;
+}
+
+void heater_get_loop_profile(loop_profile_t *profile)
+{
+    loop_profiler_get_profile(&pid_handler.profiler, profile);
+}
+
+void heater_reset_loop_profile(void)
+{
+    loop_profiler_reset(&pid_handler.profiler);
+}
+
+bool heater_get_status(heater_zone_t zone, heater_status_t *status)
+{
+    heater_statuses_t statuses;
+
+    if (zone >= HEATER_ZONE_NUMBER || data_bus_read(DATA_BUS_TOPIC_HEATER_STATUS, &statuses, sizeof(statuses)) == 0)
+    {
+        return false;
+    }
+
+    *status = statuses.zones[zone];
+
+    return true;
 }
 
 static void pid_task(void *argument)
 {
     (void)argument;
 
-    const TickType_t cycle_time = pdMS_TO_TICKS(CYCLE_TIME_MS);
+    TickType_t last_wake_time = xTaskGetTickCount();
+
+    for (heater_zone_t zone = 0; zone < HEATER_ZONE_NUMBER; zone++)
+    {
+        pid_handler.zones[zone].last_sample_tick = last_wake_time;
+        pid_handler.zones[zone].energy_tick = last_wake_time;
+        heater_output_get_counters(zone_config[zone].output_channel, &pid_handler.zones[zone].counters);
+    }
 
     for (;;)
     {
-        float current_temperature = temperature_sensor_get_temperature();
+        loop_profiler_loop_start(&pid_handler.profiler);
 
+        loop_profiler_phase_begin(&pid_handler.profiler, LOOP_PHASE_SENSOR_READ);
+        for (heater_zone_t zone = 0; zone < HEATER_ZONE_NUMBER; zone++)
+        {
+            heater_zone_handler_t *handler = &pid_handler.zones[zone];
+            temperature_sample_t sample;
+
+            if (!temperature_sensor_get_channel_sample(zone_config[zone].sensor_channel, &sample))
+            {
+                sample.temperature = NAN;
+                sample.age_ms = UINT32_MAX;
+                sample.timestamp = handler->sample_timestamp;
+            }
+
+            handler->temperature = sample.temperature;
+            handler->sample_age = sample.age_ms / 1000.0f;
+            handler->sample_timestamp = sample.timestamp;
+        }
+        loop_profiler_phase_end(&pid_handler.profiler, LOOP_PHASE_SENSOR_READ);
+
+        TickType_t sample_tick = xTaskGetTickCount();
+        TickType_t cycle_time = pdMS_TO_TICKS(pid_handler.cycle_time_ms);
+
+        loop_profiler_phase_begin(&pid_handler.profiler, LOOP_PHASE_COMPUTE);
         if (osMutexAcquire(pid_handler.mutex, osWaitForever) == osOK)
         {
-            float output = calculate_pid_output(current_temperature);
+            process_commands();
+            cycle_time = pdMS_TO_TICKS(pid_handler.cycle_time_ms);
+            loop_profiler_set_nominal_period(&pid_handler.profiler, pid_handler.cycle_time_ms * 1000);
+
+            for (heater_zone_t zone = 0; zone < HEATER_ZONE_NUMBER; zone++)
+            {
+                update_zone(zone, sample_tick);
+            }
+
+            apply_power_cap();
+
+            for (heater_zone_t zone = 0; zone < HEATER_ZONE_NUMBER; zone++)
+            {
+                heater_zone_handler_t *handler = &pid_handler.zones[zone];
+
+                heater_control_get_status(&handler->control, handler->temperature, &handler->status);
+                handler->status.timestamp = handler->sample_timestamp;
+
+                account_energy(zone, sample_tick);
+            }
+
+            publish_status();
+            retain_state();
+
             osMutexRelease(pid_handler.mutex);
+        }
+        else
+        {
+            for (heater_zone_t zone = 0; zone < HEATER_ZONE_NUMBER; zone++)
+            {
+                pid_handler.zones[zone].output = 0.0f;
+            }
+        }
+        loop_profiler_phase_end(&pid_handler.profiler, LOOP_PHASE_COMPUTE);
+
+        loop_profiler_phase_begin(&pid_handler.profiler, LOOP_PHASE_ACTUATION);
+        for (heater_zone_t zone = 0; zone < HEATER_ZONE_NUMBER; zone++)
+        {
+            apply_pid_output(zone, pid_handler.zones[zone].output);
+        }
+        loop_profiler_phase_end(&pid_handler.profiler, LOOP_PHASE_ACTUATION);
+
+        vTaskDelayUntil(&last_wake_time, cycle_time);
+        wait_for_sample();
+    }
+}
+
+/*
+ * When the master zone's last sample is older than one sensor period the
+ * cycle waits for the next one, so the controller acts on a reading that is
+ * only as old as the wake-up. The wait is bounded by a small fraction of the
+ * cycle and by one sensor period, which keeps the cycle jitter well below
+ * the cycle time; without a sample the cycle runs anyway and the supervisor
+ * sees the growing sample age.
+ */
+static void wait_for_sample(void)
+{
+    temperature_sensor_channel_t channel = zone_config[HEATER_ZONE_MASTER].sensor_channel;
+    temperature_sensor_capabilities_t capabilities;
+    temperature_samples_t samples;
+    uint32_t timeout = pdMS_TO_TICKS(pid_handler.cycle_time_ms / SAMPLE_WAIT_CYCLE_FRACTION);
+
+    if (temperature_sensor_get_channel_capabilities(channel, &capabilities))
+    {
+        uint32_t sample_period = pdMS_TO_TICKS(capabilities.sample_period_ms);
+
+        if (data_bus_read(DATA_BUS_TOPIC_TEMPERATURE, &samples, sizeof(samples)) != 0 &&
+            xTaskGetTickCount() - samples.channels[channel].sample_tick < sample_period)
+        {
+            return;
+        }
+
+        if (sample_period < timeout)
+        {
+            timeout = sample_period;
+        }
+    }
+
+    osThreadFlagsClear(PID_FLAG_SAMPLE);
+
+    TickType_t start = xTaskGetTickCount();
+    TickType_t elapsed = 0;
+
+    while (elapsed < timeout)
+    {
+        if (osThreadFlagsWait(PID_FLAG_SAMPLE, osFlagsWaitAny, timeout - elapsed) & osFlagsError)
+        {
+            return;
+        }
+
+        if (data_bus_read(DATA_BUS_TOPIC_TEMPERATURE, &samples, sizeof(samples)) != 0 && samples.updated == channel)
+        {
+            return;
+        }
+
+        elapsed = xTaskGetTickCount() - start;
+    }
+}
+
+static void publish_status(void)
+{
+    heater_statuses_t statuses;
+
+    for (heater_zone_t zone = 0; zone < HEATER_ZONE_NUMBER; zone++)
+    {
+        statuses.zones[zone] = pid_handler.zones[zone].status;
+    }
+
+    data_bus_publish(DATA_BUS_TOPIC_HEATER_STATUS, &statuses, sizeof(statuses));
+}
+
+/* Falls back to the defaults when SRAM2 holds no block sealed by this layout, e.g. after a power-on. */
+static bool restore_state(void)
+{
+    if (!retention_is_valid(&heater_retained.header, RETAINED_MAGIC, heater_retained.zones, sizeof(heater_retained.zones)))
+    {
+        return false;
+    }
 
-            apply_pid_output(output);
+    for (heater_zone_t zone = 0; zone < HEATER_ZONE_NUMBER; zone++)
+    {
+        heater_zone_handler_t *handler = &pid_handler.zones[zone];
+        const heater_zone_retained_t *retained = &heater_retained.zones[zone];
+
+        if (!heater_control_restore(&handler->control, &retained->control))
+        {
+            heater_control_init(&handler->control);
+            heater_control_set_mode(&handler->control, zone_config[zone].initial_mode);
+            continue;
         }
 
-        vTaskDelay(cycle_time);
+        handler->coupled = retained->coupled;
+        handler->setpoint_offset = retained->setpoint_offset;
+        heater_control_get_status(&handler->control, NAN, &handler->status);
     }
+
+    return true;
 }
 
-static float calculate_pid_output(float current_temperature)
+static void retain_state(void)
 {
-    float error = pid_handler.pid_params.setpoint - current_temperature;
+    for (heater_zone_t zone = 0; zone < HEATER_ZONE_NUMBER; zone++)
+    {
+        heater_zone_handler_t *handler = &pid_handler.zones[zone];
+        heater_zone_retained_t *retained = &heater_retained.zones[zone];
 
-    pid_handler.pid_params.integral += error * (CYCLE_TIME_MS / 1000.0f);
-    if (pid_handler.pid_params.integral > 100.0f / pid_handler.pid_params.ki)
+        heater_control_retain(&handler->control, &retained->control);
+        retained->coupled = handler->coupled;
+        retained->setpoint_offset = handler->setpoint_offset;
+    }
+
+    retention_seal(&heater_retained.header, RETAINED_MAGIC, heater_retained.zones, sizeof(heater_retained.zones));
+}
+
+static void update_zone(heater_zone_t zone, TickType_t sample_tick)
+{
+    heater_zone_handler_t *handler = &pid_handler.zones[zone];
+    heater_control_t *master = &pid_handler.zones[HEATER_ZONE_MASTER].control;
+
+    handler->output = 0.0f;
+
+    if (zone != HEATER_ZONE_MASTER && handler->coupled)
     {
-        pid_handler.pid_params.integral = 100.0f / pid_handler.pid_params.ki;
+        /* The offset is only checked for being finite, so the sum is held to the setpoint limit. */
+        handler->control.pid_params.setpoint = fminf(master->pid_params.setpoint + handler->setpoint_offset, HEATER_CONTROL_MAX_SETPOINT);
     }
-    else if (pid_handler.pid_params.integral < -50.0f / pid_handler.pid_params.ki)
+
+    float dt = (float)(sample_tick - handler->last_sample_tick) / configTICK_RATE_HZ;
+
+    if (dt <= 0.0f)
     {
-        pid_handler.pid_params.integral = -50.0f / pid_handler.pid_params.ki;
+        dt = pid_handler.cycle_time_ms / 1000.0f;
     }
 
-    float derivative = (error - pid_handler.pid_params.previous_error) / (CYCLE_TIME_MS / 1000.0f);
+    handler->dt = dt;
 
-    float output = pid_handler.pid_params.kp * error +
-                   pid_handler.pid_params.ki * pid_handler.pid_params.integral +
-                   pid_handler.pid_params.kd * derivative;
+    heater_control_supervise(&handler->control, handler->temperature, handler->sample_age, dt);
 
-    if (output > 100.0f) output = 100.0f;
-    if (output < 0.0f) output = 0.0f;
+    if (isnan(handler->temperature))
+    {
+        return;
+    }
 
-    pid_handler.pid_params.current_power = output;
-    pid_handler.pid_params.previous_error = error;
-    return output;
+    handler->output = heater_control_update(&handler->control, handler->temperature, dt);
+    handler->last_sample_tick = sample_tick;
 }
 
-static void apply_pid_output(float pid_output)
+/* Scales all zones down evenly when their sum exceeds the cap and lets each controller track the result. */
+static void apply_power_cap(void)
 {
-    float current_temperature = temperature_sensor_get_temperature();
+    float total = 0.0f;
 
-    float duty_cycle = pid_output / 100.0f;
-    TickType_t on_time = (TickType_t)(duty_cycle * CYCLE_TIME_MS);
-    TickType_t off_time = CYCLE_TIME_MS - on_time;
+    for (heater_zone_t zone = 0; zone < HEATER_ZONE_NUMBER; zone++)
+    {
+        total += pid_handler.zones[zone].output;
+    }
 
-    if (on_time > 0 && on_time < MIN_HEATER_TIME_MS)
+    if (total <= pid_handler.power_cap)
     {
-        on_time = MIN_HEATER_TIME_MS;
-        off_time = CYCLE_TIME_MS - on_time;
+        return;
     }
 
-    if (pid_output <= 0.0f)
+    float scale = pid_handler.power_cap / total;
+
+    /* The controllers integrated over the measured interval, so the correction uses the same one. */
+    for (heater_zone_t zone = 0; zone < HEATER_ZONE_NUMBER; zone++)
+    {
+        heater_zone_handler_t *handler = &pid_handler.zones[zone];
+
+        handler->output *= scale;
+        heater_control_limit_output(&handler->control, handler->output, handler->dt);
+    }
+}
+
+static void apply_pid_output(heater_zone_t zone, float pid_output)
+{
+    heater_output_set_duty(zone_config[zone].output_channel, pid_output);
+    pid_handler.zones[zone].heater_state = (pid_output > 0.0f);
+}
+
+/* Feeds the output stage's on-time and switch counters since the last cycle into the zone's energy meter and metrics. */
+static void account_energy(heater_zone_t zone, TickType_t now)
+{
+    heater_zone_handler_t *handler = &pid_handler.zones[zone];
+    heater_output_counters_t counters;
+
+    if (!heater_output_get_counters(zone_config[zone].output_channel, &counters))
     {
-        heater_turn_off();
-        vTaskDelay(CYCLE_TIME_MS);
         return;
     }
 
-    heater_turn_on();
-    vTaskDelay(on_time);
+    uint32_t elapsed_ms = (uint32_t)((uint64_t)(now - handler->energy_tick) * 1000 / configTICK_RATE_HZ);
+    uint32_t switch_count = counters.switch_count - handler->counters.switch_count;
+
+    energy_meter_update(&handler->energy, (uint32_t)(counters.on_time_ms - handler->counters.on_time_ms), elapsed_ms, switch_count);
+    control_metrics_add_switches(&handler->control.metrics, switch_count);
 
-    heater_turn_off();
-    vTaskDelay(off_time);
+    /* The interval just accounted ran before this cycle's program start or up to its end. */
+    if (handler->status.program_running && !handler->energy.program_running)
+    {
+        energy_meter_program_start(&handler->energy);
+    }
+    else if (!handler->status.program_running && handler->energy.program_running)
+    {
+        energy_meter_program_stop(&handler->energy);
+    }
 
-    pid_handler.pid_params.previous_temperature = current_temperature;
+    handler->counters = counters;
+    handler->energy_tick = now;
 }
 
 void heater_turn_on(void)
 {
-    HAL_GPIO_WritePin(HEATER_ON_GPIO_Port, HEATER_ON_Pin, GPIO_PIN_SET);
-    pid_handler.heater_state = true;
+    for (heater_zone_t zone = 0; zone < HEATER_ZONE_NUMBER; zone++)
+    {
+        heater_set_mode(zone, HEATER_MODE_ON);
+    }
 }
 
 void heater_turn_off(void)
 {
-    HAL_GPIO_WritePin(HEATER_ON_GPIO_Port, HEATER_ON_Pin, GPIO_PIN_RESET);
-    pid_handler.heater_state = false;
+    for (heater_zone_t zone = 0; zone < HEATER_ZONE_NUMBER; zone++)
+    {
+        heater_set_mode(zone, HEATER_MODE_OFF);
+    }
+}
+
+static bool validate_command(const heater_command_t *command)
+{
+    if (command->type != HEATER_COMMAND_SET_POWER_CAP && command->type != HEATER_COMMAND_SET_OUTPUT_MODE && command->zone >= HEATER_ZONE_NUMBER)
+    {
+        return false;
+    }
+
+    switch (command->type)
+    {
+        case HEATER_COMMAND_SET_MODE:
+            return command->mode < HEATER_MODE_NUMBER && command->mode != HEATER_MODE_AUTOTUNE;
+        case HEATER_COMMAND_SET_SETPOINT:
+            return isfinite(command->setpoint) && command->setpoint <= HEATER_CONTROL_MAX_SETPOINT;
+        case HEATER_COMMAND_SET_GAINS:
+            return pid_controller_gains_valid(command->kp, command->ki, command->kd);
+        case HEATER_COMMAND_SET_CONTROLLER:
+            return command->controller < HEATER_CONTROLLER_NUMBER;
+        case HEATER_COMMAND_AUTOTUNE_START:
+            return command->rule < AUTOTUNE_RULE_NUMBER;
+        case HEATER_COMMAND_PROGRAM_START:
+            return setpoint_program_validate(command->segments, command->segment_count, HEATER_CONTROL_MAX_SETPOINT);
+        case HEATER_COMMAND_SET_COUPLING:
+            return command->zone != HEATER_ZONE_MASTER && isfinite(command->setpoint_offset);
+        case HEATER_COMMAND_SET_POWER_CAP:
+            return command->power_cap >= 0.0f && command->power_cap <= MAX_POWER_CAP;
+        case HEATER_COMMAND_SET_OUTPUT_MODE:
+            return command->output_mode < HEATER_OUTPUT_MODE_NUMBER;
+        case HEATER_COMMAND_AUTOTUNE_STOP:
+        case HEATER_COMMAND_PROGRAM_STOP:
+        case HEATER_COMMAND_CLEAR_FAULT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Called by the PID task with the mutex held, so commands land between control cycles. */
+static void process_commands(void)
+{
+    heater_command_t command;
+
+    while (osMessageQueueGet(pid_handler.command_queue, &command, NULL, 0) == osOK)
+    {
+        apply_command(&command);
+    }
+}
+
+static void apply_command(const heater_command_t *command)
+{
+    if (command->type == HEATER_COMMAND_SET_POWER_CAP)
+    {
+        pid_handler.power_cap = command->power_cap;
+        return;
+    }
+
+    /* Applied between cycles; the next cycle sets the duties again in the new mode. */
+    if (command->type == HEATER_COMMAND_SET_OUTPUT_MODE)
+    {
+        heater_output_set_mode(command->output_mode);
+        return;
+    }
+
+    heater_zone_handler_t *handler = &pid_handler.zones[command->zone];
+    heater_control_t *control = &handler->control;
+
+    switch (command->type)
+    {
+        case HEATER_COMMAND_SET_MODE:
+            heater_control_set_mode(control, command->mode);
+            break;
+        case HEATER_COMMAND_SET_SETPOINT:
+            heater_control_set_setpoint(control, command->setpoint, handler->temperature);
+            break;
+        case HEATER_COMMAND_SET_GAINS:
+            heater_control_set_gains(control, command->kp, command->ki, command->kd);
+            break;
+        case HEATER_COMMAND_SET_CONTROLLER:
+            heater_control_select_controller(control, command->controller);
+            break;
+        case HEATER_COMMAND_AUTOTUNE_START:
+            heater_control_start_autotune(control, command->rule);
+            break;
+        case HEATER_COMMAND_AUTOTUNE_STOP:
+            heater_control_stop_autotune(control);
+            break;
+        case HEATER_COMMAND_PROGRAM_START:
+            heater_control_start_program(control, command->segments, command->segment_count, handler->temperature);
+            handler->program_queued = false;
+            break;
+        case HEATER_COMMAND_PROGRAM_STOP:
+            heater_control_stop_program(control);
+            break;
+        case HEATER_COMMAND_CLEAR_FAULT:
+            heater_control_clear_fault(control);
+            break;
+        case HEATER_COMMAND_SET_COUPLING:
+            handler->coupled = command->coupled;
+            handler->setpoint_offset = command->setpoint_offset;
+            if (handler->coupled)
+            {
+                heater_control_stop_program(control);
+            }
+            break;
+        default:
+            break;
+    }
 }
@@ -1,7 +1,102 @@
 #pragma once
 #include <stdbool.h>
+#include <stdint.h>
 #include "cmsis_os.h"
+#include "heater_control.h"
+#include "loop_profiler.h"
+#include "energy_meter.h"
+#include "heater_output.h"
+
+typedef enum
+{
+    HEATER_ZONE_TOP,
+    HEATER_ZONE_BOTTOM,
+
+    HEATER_ZONE_NUMBER,
+} heater_zone_t;
+
+#define HEATER_ZONE_MASTER HEATER_ZONE_TOP
+
+typedef enum
+{
+    HEATER_COMMAND_SET_MODE,
+    HEATER_COMMAND_SET_SETPOINT,
+    HEATER_COMMAND_SET_GAINS,
+    HEATER_COMMAND_SET_CONTROLLER,
+    HEATER_COMMAND_AUTOTUNE_START,
+    HEATER_COMMAND_AUTOTUNE_STOP,
+    HEATER_COMMAND_PROGRAM_START,
+    HEATER_COMMAND_PROGRAM_STOP,
+    HEATER_COMMAND_SET_COUPLING,
+    HEATER_COMMAND_SET_POWER_CAP,
+    HEATER_COMMAND_SET_OUTPUT_MODE,
+    HEATER_COMMAND_CLEAR_FAULT,
+
+    HEATER_COMMAND_NUMBER,
+} heater_command_type_t;
+
+typedef struct
+{
+    heater_command_type_t type;
+    heater_zone_t zone;
+    heater_mode_t mode;
+    heater_controller_t controller;
+    autotune_rule_t rule;
+    float setpoint;
+    float kp;
+    float ki;
+    float kd;
+    const setpoint_segment_t *segments; /* copied when the command is sent */
+    uint8_t segment_count;
+    bool coupled;
+    float setpoint_offset;
+    float power_cap;
+    heater_output_mode_t output_mode;
+} heater_command_t;
+
+/* Data bus HEATER_STATUS payload: every zone, published once per control cycle. */
+typedef struct
+{
+    heater_status_t zones[HEATER_ZONE_NUMBER];
+} heater_statuses_t;
 
 bool heater_init(void);
 void heater_turn_on(void);
 void heater_turn_off(void);
+bool heater_set_cycle_time(uint32_t cycle_time_ms);
+uint32_t heater_get_cycle_time(void);
+float heater_get_setpoint(heater_zone_t zone);
+bool heater_get_metrics(heater_zone_t zone, control_metrics_t *metrics);
+
+bool heater_send_command(const heater_command_t *command);
+bool heater_set_mode(heater_zone_t zone, heater_mode_t mode);
+bool heater_set_setpoint(heater_zone_t zone, float setpoint);
+bool heater_set_gains(heater_zone_t zone, float kp, float ki, float kd);
+bool heater_set_coupling(heater_zone_t zone, bool coupled, float setpoint_offset);
+bool heater_clear_fault(heater_zone_t zone);
+thermal_fault_t heater_get_fault(heater_zone_t zone);
+bool heater_set_power_cap(float total_percent);
+float heater_get_power_cap(void);
+bool heater_set_output_mode(heater_output_mode_t mode);
+heater_output_mode_t heater_get_output_mode(void);
+bool heater_set_heater_power(heater_zone_t zone, float watts);
+bool heater_get_energy(heater_zone_t zone, energy_meter_t *energy);
+bool heater_reset_energy(heater_zone_t zone);
+bool heater_get_status(heater_zone_t zone, heater_status_t *status);
+void heater_get_loop_profile(loop_profile_t *profile);
+void heater_reset_loop_profile(void);
+
+bool heater_set_gain_schedule(heater_zone_t zone, const pid_gain_set_t *table, uint8_t count, pid_schedule_source_t source);
+bool heater_set_controller(heater_zone_t zone, heater_controller_t controller);
+heater_controller_t heater_get_controller(heater_zone_t zone);
+bool heater_set_model(heater_zone_t zone, const fopdt_model_t *model, float closed_loop_time);
+bool heater_get_model(heater_zone_t zone, fopdt_model_t *model);
+
+bool heater_autotune_start(heater_zone_t zone, autotune_rule_t rule);
+void heater_autotune_stop(heater_zone_t zone);
+autotune_state_t heater_autotune_get_state(heater_zone_t zone);
+bool heater_autotune_get_result(heater_zone_t zone, autotune_result_t *result);
+
+bool heater_program_start(heater_zone_t zone, const setpoint_segment_t *segments, uint8_t segment_count);
+void heater_program_stop(heater_zone_t zone);
+bool heater_program_is_running(heater_zone_t zone);
@@ -0,0 +1,400 @@
+/**
+ * Heater control logic: setpoint program, auto-tuner, PID sequencing and
+ * the thermal supervisor that can force the output off
+ *
+ * Kept free of RTOS and HAL dependencies; heater.c runs it from the PID
+ * task and the host simulator in Tools/thermal_sim links it directly.
+ */
+
+#include "heater_control.h"
+
+#include <math.h>
+#include <stddef.h>
+
+#define AUTOTUNE_HYSTERESIS 0.2f
+#define AUTOTUNE_CYCLES 4
+#define AUTOTUNE_TIMEOUT_S (4.0f * 3600.0f)
+#define SETTLING_BAND 0.5f
+
+static void install_autotune_result(heater_control_t *control, float current_temperature);
+static void transfer_to_controller(heater_control_t *control, float output);
+
+void heater_control_init(heater_control_t *control)
+{
+    pid_controller_init(&control->pid_params, HEATER_CONTROL_DEFAULT_KP, HEATER_CONTROL_DEFAULT_KI, HEATER_CONTROL_DEFAULT_KD);
+    control->pid_params.setpoint = HEATER_CONTROL_DEFAULT_SETPOINT;
+    control->controller = HEATER_CONTROLLER_PID;
+    control->smith.valid = false;
+
+    control->mode = HEATER_MODE_KEEP;
+    control->mode_before_autotune = HEATER_MODE_KEEP;
+    control->autotune.state = AUTOTUNE_STATE_IDLE;
+    control->program.running = false;
+
+    control_metrics_reset(&control->metrics, control->pid_params.setpoint, control->pid_params.setpoint, SETTLING_BAND);
+    thermal_supervisor_init(&control->supervisor, NULL);
+}
+
+float heater_control_update(heater_control_t *control, float current_temperature, float dt)
+{
+    float output;
+
+    if (thermal_supervisor_get_fault(&control->supervisor) != THERMAL_FAULT_NONE)
+    {
+        control->pid_params.current_power = PID_CONTROLLER_OUTPUT_MIN;
+        return PID_CONTROLLER_OUTPUT_MIN;
+    }
+
+    if (setpoint_program_is_running(&control->program) && control->mode != HEATER_MODE_AUTOTUNE)
+    {
+        control->pid_params.setpoint = setpoint_program_update(&control->program, current_temperature, dt);
+    }
+
+    if (control->mode == HEATER_MODE_AUTOTUNE)
+    {
+        output = autotune_update(&control->autotune, current_temperature, dt);
+        autotune_state_t state = autotune_get_state(&control->autotune);
+
+        if (state == AUTOTUNE_STATE_RUNNING)
+        {
+            control->pid_params.current_power = output;
+            control_metrics_update(&control->metrics, control->pid_params.setpoint, current_temperature, dt);
+            return output;
+        }
+
+        if (state == AUTOTUNE_STATE_DONE)
+        {
+            install_autotune_result(control, current_temperature);
+        }
+        else
+        {
+            transfer_to_controller(control, control->pid_params.current_power);
+        }
+
+        control->mode = control->mode_before_autotune;
+    }
+
+    if (control->mode == HEATER_MODE_OFF || control->mode == HEATER_MODE_ON)
+    {
+        output = (control->mode == HEATER_MODE_ON) ? PID_CONTROLLER_OUTPUT_MAX : PID_CONTROLLER_OUTPUT_MIN;
+        control->pid_params.current_power = output;
+    }
+    else if (control->controller == HEATER_CONTROLLER_SMITH)
+    {
+        output = smith_predictor_update(&control->smith, control->pid_params.setpoint, current_temperature, dt);
+        control->pid_params.current_power = output;
+    }
+    else
+    {
+        output = pid_controller_update(&control->pid_params, current_temperature, dt);
+    }
+
+    control_metrics_update(&control->metrics, control->pid_params.setpoint, current_temperature, dt);
+
+    return output;
+}
+
+/* Runs every cycle, also without a valid sample; a new fault stops the zone and latches until cleared. */
+thermal_fault_t heater_control_supervise(heater_control_t *control, float current_temperature, float sample_age, float dt)
+{
+    bool armed = (control->mode != HEATER_MODE_OFF);
+    bool was_faulted = (thermal_supervisor_get_fault(&control->supervisor) != THERMAL_FAULT_NONE);
+    thermal_fault_t fault = thermal_supervisor_update(&control->supervisor, current_temperature, sample_age, control->pid_params.current_power, armed, dt);
+
+    if (fault != THERMAL_FAULT_NONE && !was_faulted)
+    {
+        if (control->mode == HEATER_MODE_AUTOTUNE)
+        {
+            autotune_stop(&control->autotune);
+        }
+
+        setpoint_program_stop(&control->program);
+        control->mode = HEATER_MODE_OFF;
+        control->pid_params.current_power = PID_CONTROLLER_OUTPUT_MIN;
+    }
+
+    return fault;
+}
+
+void heater_control_clear_fault(heater_control_t *control)
+{
+    thermal_supervisor_clear_fault(&control->supervisor);
+}
+
+bool heater_control_set_mode(heater_control_t *control, heater_mode_t mode)
+{
+    if (mode >= HEATER_MODE_NUMBER || mode == HEATER_MODE_AUTOTUNE)
+    {
+        return false;
+    }
+
+    if (mode != HEATER_MODE_OFF && thermal_supervisor_get_fault(&control->supervisor) != THERMAL_FAULT_NONE)
+    {
+        return false;
+    }
+
+    if (control->mode == HEATER_MODE_AUTOTUNE)
+    {
+        autotune_stop(&control->autotune);
+    }
+
+    if (mode == HEATER_MODE_KEEP && control->mode != HEATER_MODE_KEEP)
+    {
+        transfer_to_controller(control, control->pid_params.current_power);
+    }
+
+    control->mode = mode;
+
+    return true;
+}
+
+bool heater_control_set_setpoint(heater_control_t *control, float setpoint, float current_temperature)
+{
+    if (!isfinite(setpoint) || setpoint > HEATER_CONTROL_MAX_SETPOINT)
+    {
+        return false;
+    }
+
+    setpoint_program_stop(&control->program);
+    control->pid_params.setpoint = setpoint;
+    control_metrics_reset(&control->metrics, setpoint, current_temperature, SETTLING_BAND);
+
+    return true;
+}
+
+bool heater_control_set_gains(heater_control_t *control, float kp, float ki, float kd)
+{
+    if (!pid_controller_gains_valid(kp, ki, kd))
+    {
+        return false;
+    }
+
+    /* Explicit gains replace any schedule. */
+    control->pid_params.schedule_source = PID_SCHEDULE_OFF;
+    pid_controller_set_gains(&control->pid_params, kp, ki, kd);
+
+    return true;
+}
+
+void heater_control_limit_output(heater_control_t *control, float output, float dt)
+{
+    if (control->mode == HEATER_MODE_KEEP)
+    {
+        pid_parameters_t *pid = (control->controller == HEATER_CONTROLLER_SMITH) ? &control->smith.pid : &control->pid_params;
+        pid_controller_track_output(pid, output, dt);
+    }
+
+    control->pid_params.current_power = output;
+}
+
+void heater_control_get_status(const heater_control_t *control, float current_temperature, heater_status_t *status)
+{
+    const pid_parameters_t *pid = (control->controller == HEATER_CONTROLLER_SMITH) ? &control->smith.pid : &control->pid_params;
+
+    status->mode = control->mode;
+    status->controller = control->controller;
+    status->autotune_state = autotune_get_state(&control->autotune);
+    status->program_running = setpoint_program_is_running(&control->program);
+    status->fault = thermal_supervisor_get_fault(&control->supervisor);
+    status->timestamp = 0;
+    status->setpoint = control->pid_params.setpoint;
+    status->temperature = current_temperature;
+    status->power = control->pid_params.current_power;
+    status->error = control->pid_params.setpoint - current_temperature;
+    status->integral = pid->integral;
+    status->kp = pid->kp;
+    status->ki = pid->ki;
+    status->kd = pid->kd;
+}
+
+void heater_control_retain(const heater_control_t *control, heater_control_retained_t *retained)
+{
+    retained->mode = (control->mode == HEATER_MODE_AUTOTUNE) ? control->mode_before_autotune : control->mode;
+    retained->setpoint = control->pid_params.setpoint;
+    retained->output = control->pid_params.current_power;
+    retained->kp = control->pid_params.kp;
+    retained->ki = control->pid_params.ki;
+    retained->kd = control->pid_params.kd;
+    retained->program = control->program;
+    retained->fault = thermal_supervisor_get_fault(&control->supervisor);
+}
+
+/* Resumes on PID from a freshly initialised control; the integral is rebuilt from the last output, as on any hand-over. */
+bool heater_control_restore(heater_control_t *control, const heater_control_retained_t *retained)
+{
+    if (retained->mode >= HEATER_MODE_NUMBER || retained->mode == HEATER_MODE_AUTOTUNE || retained->fault >= THERMAL_FAULT_NUMBER ||
+        !isfinite(retained->setpoint) || retained->setpoint > HEATER_CONTROL_MAX_SETPOINT || !isfinite(retained->output) ||
+        !heater_control_set_gains(control, retained->kp, retained->ki, retained->kd))
+    {
+        return false;
+    }
+
+    control->pid_params.setpoint = retained->setpoint;
+    control->program = retained->program;
+    control->mode = retained->mode;
+    pid_controller_transfer(&control->pid_params, retained->output);
+
+    if (retained->fault != THERMAL_FAULT_NONE)
+    {
+        thermal_supervisor_latch_fault(&control->supervisor, retained->fault);
+        setpoint_program_stop(&control->program);
+        control->mode = HEATER_MODE_OFF;
+        control->pid_params.current_power = PID_CONTROLLER_OUTPUT_MIN;
+    }
+
+    control_metrics_reset(&control->metrics, control->pid_params.setpoint, control->pid_params.setpoint, SETTLING_BAND);
+
+    return true;
+}
+
+bool heater_control_start_autotune(heater_control_t *control, autotune_rule_t rule)
+{
+    if (rule >= AUTOTUNE_RULE_NUMBER || thermal_supervisor_get_fault(&control->supervisor) != THERMAL_FAULT_NONE)
+    {
+        return false;
+    }
+
+    const autotune_config_t config =
+    {
+        .setpoint = control->pid_params.setpoint,
+        .output_high = 100.0f,
+        .output_low = 0.0f,
+        .hysteresis = AUTOTUNE_HYSTERESIS,
+        .cycles = AUTOTUNE_CYCLES,
+        .timeout_s = AUTOTUNE_TIMEOUT_S,
+        .rule = rule,
+    };
+
+    if (control->mode != HEATER_MODE_AUTOTUNE)
+    {
+        control->mode_before_autotune = control->mode;
+    }
+
+    autotune_start(&control->autotune, &config);
+    control->mode = HEATER_MODE_AUTOTUNE;
+
+    return true;
+}
+
+void heater_control_stop_autotune(heater_control_t *control)
+{
+    if (control->mode == HEATER_MODE_AUTOTUNE)
+    {
+        autotune_stop(&control->autotune);
+        transfer_to_controller(control, control->pid_params.current_power);
+        control->mode = control->mode_before_autotune;
+    }
+}
+
+bool heater_control_start_program(heater_control_t *control, const setpoint_segment_t *segments, uint8_t segment_count, float current_temperature)
+{
+    float initial_setpoint = isnan(current_temperature) ? control->pid_params.setpoint : current_temperature;
+
+    if (!setpoint_program_start(&control->program, segments, segment_count, initial_setpoint, HEATER_CONTROL_MAX_SETPOINT))
+    {
+        return false;
+    }
+
+    bool first_has_target = (segments[0].type == SETPOINT_SEGMENT_STEP || segments[0].type == SETPOINT_SEGMENT_RAMP);
+    control_metrics_reset(&control->metrics, first_has_target ? segments[0].target : initial_setpoint, initial_setpoint, SETTLING_BAND);
+
+    return true;
+}
+
+void heater_control_stop_program(heater_control_t *control)
+{
+    setpoint_program_stop(&control->program);
+}
+
+bool heater_control_set_model(heater_control_t *control, const fopdt_model_t *model, float closed_loop_time)
+{
+    if (!smith_predictor_init(&control->smith, model, closed_loop_time))
+    {
+        control->controller = HEATER_CONTROLLER_PID;
+        transfer_to_controller(control, control->pid_params.current_power);
+        return false;
+    }
+
+    thermal_supervisor_set_model(&control->supervisor, model);
+    transfer_to_controller(control, control->pid_params.current_power);
+
+    return true;
+}
+
+bool heater_control_set_gain_schedule(heater_control_t *control, const pid_gain_set_t *table, uint8_t count, pid_schedule_source_t source)
+{
+    return pid_controller_set_schedule(&control->pid_params, table, count, source);
+}
+
+bool heater_control_select_controller(heater_control_t *control, heater_controller_t controller)
+{
+    if (controller >= HEATER_CONTROLLER_NUMBER || (controller == HEATER_CONTROLLER_SMITH && !control->smith.valid))
+    {
+        return false;
+    }
+
+    if (controller != control->controller)
+    {
+        control->controller = controller;
+        transfer_to_controller(control, control->pid_params.current_power);
+    }
+
+    return true;
+}
+
+/* Installs the tuned gains and hands over from the relay's mean output. */
+static void install_autotune_result(heater_control_t *control, float current_temperature)
+{
+    autotune_result_t result;
+
+    if (!autotune_get_result(&control->autotune, &result) || result.ki <= 0.0f)
+    {
+        transfer_to_controller(control, control->pid_params.current_power);
+        return;
+    }
+
+    fopdt_model_t model;
+
+    if (control->pid_params.schedule_source != PID_SCHEDULE_OFF)
+    {
+        /* With a schedule active the result becomes the band at the tuning setpoint. */
+        const pid_gain_set_t gain_set =
+        {
+            .temperature = control->autotune.config.setpoint,
+            .kp = result.kp,
+            .ki = result.ki,
+            .kd = result.kd,
+        };
+
+        pid_controller_store_gain_set(&control->pid_params, &gain_set);
+    }
+    else
+    {
+        pid_controller_set_gains(&control->pid_params, result.kp, result.ki, result.kd);
+    }
+
+    if (smith_predictor_model_from_autotune(&result, &model))
+    {
+        smith_predictor_init(&control->smith, &model, 0.0f);
+        thermal_supervisor_set_model(&control->supervisor, &model);
+    }
+
+    if (!control->smith.valid)
+    {
+        control->controller = HEATER_CONTROLLER_PID;
+    }
+
+    transfer_to_controller(control, result.mean_output);
+
+    control_metrics_reset(&control->metrics, control->pid_params.setpoint, current_temperature, SETTLING_BAND);
+}
+
+static void transfer_to_controller(heater_control_t *control, float output)
+{
+    if (control->controller == HEATER_CONTROLLER_SMITH)
+    {
+        smith_predictor_transfer(&control->smith, control->pid_params.setpoint, output);
+    }
+
+    pid_controller_transfer(&control->pid_params, output);
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pid_controller.h"
+#include "smith_predictor.h"
+#include "autotune.h"
+#include "setpoint_program.h"
+#include "control_metrics.h"
+#include "thermal_supervisor.h"
+
+#define HEATER_CONTROL_DEFAULT_KP 15.0f
+#define HEATER_CONTROL_DEFAULT_KI 0.4f
+#define HEATER_CONTROL_DEFAULT_KD 0.4f
+#define HEATER_CONTROL_DEFAULT_SETPOINT 50.0f
+#define HEATER_CONTROL_MAX_SETPOINT 150.0f
+
+typedef enum
+{
+    HEATER_MODE_OFF,
+    HEATER_MODE_ON,
+    HEATER_MODE_KEEP,
+    HEATER_MODE_AUTOTUNE,
+
+    HEATER_MODE_NUMBER,
+} heater_mode_t;
+
+typedef enum
+{
+    HEATER_CONTROLLER_PID,
+    HEATER_CONTROLLER_SMITH,
+
+    HEATER_CONTROLLER_NUMBER,
+} heater_controller_t;
+
+typedef struct
+{
+    pid_parameters_t pid_params;
+    heater_controller_t controller;
+    smith_predictor_t smith;
+    heater_mode_t mode;
+    heater_mode_t mode_before_autotune;
+    autotune_t autotune;
+    setpoint_program_t program;
+    control_metrics_t metrics;
+    thermal_supervisor_t supervisor;
+} heater_control_t;
+
+typedef struct
+{
+    heater_mode_t mode;
+    heater_controller_t controller;
+    autotune_state_t autotune_state;
+    bool program_running;
+    thermal_fault_t fault;
+    uint64_t timestamp;
+
+    float setpoint;
+    float temperature;
+    float power;
+    float error;
+    float integral;
+    float kp;
+    float ki;
+    float kd;
+} heater_status_t;
+
+/* State kept across a warm reset; autotune runs are not resumed. */
+typedef struct
+{
+    heater_mode_t mode;
+    float setpoint;
+    float output;
+    float kp;
+    float ki;
+    float kd;
+    setpoint_program_t program;
+    thermal_fault_t fault;
+} heater_control_retained_t;
+
+void heater_control_init(heater_control_t *control);
+float heater_control_update(heater_control_t *control, float current_temperature, float dt);
+thermal_fault_t heater_control_supervise(heater_control_t *control, float current_temperature, float sample_age, float dt);
+void heater_control_clear_fault(heater_control_t *control);
+void heater_control_limit_output(heater_control_t *control, float output, float dt);
+void heater_control_get_status(const heater_control_t *control, float current_temperature, heater_status_t *status);
+void heater_control_retain(const heater_control_t *control, heater_control_retained_t *retained);
+bool heater_control_restore(heater_control_t *control, const heater_control_retained_t *retained);
+
+bool heater_control_set_mode(heater_control_t *control, heater_mode_t mode);
+bool heater_control_set_setpoint(heater_control_t *control, float setpoint, float current_temperature);
+bool heater_control_set_gains(heater_control_t *control, float kp, float ki, float kd);
+
+bool heater_control_start_autotune(heater_control_t *control, autotune_rule_t rule);
+void heater_control_stop_autotune(heater_control_t *control);
+
+bool heater_control_start_program(heater_control_t *control, const setpoint_segment_t *segments, uint8_t segment_count, float current_temperature);
+void heater_control_stop_program(heater_control_t *control);
+
+bool heater_control_set_model(heater_control_t *control, const fopdt_model_t *model, float closed_loop_time);
+bool heater_control_set_gain_schedule(heater_control_t *control, const pid_gain_set_t *table, uint8_t count, pid_schedule_source_t source);
+bool heater_control_select_controller(heater_control_t *control, heater_controller_t controller);
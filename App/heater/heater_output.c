@@ -0,0 +1,341 @@
+/**
+ * Heater output stage, slow PWM or burst fire generated by TIM3
+ *
+ * The heater pins have no timer alternate function, so the timer drives
+ * them from its interrupts. In slow PWM mode the update event opens the
+ * window for every output and each output's compare channel closes it.
+ *
+ * In burst-fire mode the timer runs at the mains half-cycle and every
+ * update switches the outputs chosen by the burst-fire scheduler, so a
+ * zero-crossing SSR conducts whole half-cycles only. When the zero-cross
+ * detector delivers edges they restart the timer and step the scheduler;
+ * if they stop, the free-running timer takes over.
+ *
+ * Every pin change is accounted for, giving the real on-time and the number
+ * of switch-ons of each output for energy and relay-wear statistics.
+ *
+ * Stop 2 is inhibited while any output has a duty set: TIM3 stops with the
+ * bus clocks and would leave a pin on for the whole idle period.
+ */
+
+#include "heater_output.h"
+
+#include <math.h>
+
+#include "main.h"
+#include "tim.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "burst_fire.h"
+#include "low_power.h"
+
+#define HEATER_TIMER_HANDLE htim3
+
+#define MIN_HEATER_TIME_MS 20
+#define TIMER_TICKS_PER_MS 10
+
+#define MAINS_FREQUENCY_HZ 50
+#define HALF_CYCLE_TICKS (TIMER_TICKS_PER_MS * 1000 / (2 * MAINS_FREQUENCY_HZ))
+#define BURST_WINDOW_HALF_CYCLES 100
+#define ZERO_CROSS_TIMEOUT_HALF_CYCLES 3
+
+typedef struct
+{
+    GPIO_TypeDef *port;
+    uint16_t pin;
+    uint32_t timer_channel;
+    HAL_TIM_ActiveChannel active_channel;
+} heater_output_config_t;
+
+typedef struct
+{
+    heater_output_mode_t mode;
+    uint32_t slow_pwm_period;
+    float duty[HEATER_OUTPUT_NUMBER];
+    volatile uint32_t compare[HEATER_OUTPUT_NUMBER];
+    burst_fire_t burst;
+    volatile uint8_t missed_zero_crosses;
+
+    bool pin_on[HEATER_OUTPUT_NUMBER];
+    uint32_t on_since_ms[HEATER_OUTPUT_NUMBER];
+    heater_output_counters_t counters[HEATER_OUTPUT_NUMBER];
+} heater_output_handler_t;
+
+static const heater_output_config_t output_config[HEATER_OUTPUT_NUMBER] =
+{
+    [HEATER_OUTPUT_1] = { HEATER_ON_GPIO_Port, HEATER_ON_Pin, TIM_CHANNEL_1, HAL_TIM_ACTIVE_CHANNEL_1 },
+    [HEATER_OUTPUT_2] = { HEATER_2_ON_GPIO_Port, HEATER_2_ON_Pin, TIM_CHANNEL_2, HAL_TIM_ACTIVE_CHANNEL_2 },
+};
+
+static heater_output_handler_t output_handler;
+
+static uint32_t duty_to_compare(float duty_percent, uint32_t period);
+static void burst_step(void);
+static void write_pin(heater_output_channel_t channel, bool on);
+static void update_stop_inhibit(void);
+
+bool heater_output_init(void)
+{
+    bool channels_ok = true;
+
+    output_handler.mode = HEATER_OUTPUT_MODE_SLOW_PWM;
+    output_handler.slow_pwm_period = __HAL_TIM_GET_AUTORELOAD(&HEATER_TIMER_HANDLE) + 1;
+    output_handler.missed_zero_crosses = ZERO_CROSS_TIMEOUT_HALF_CYCLES;
+    burst_fire_init(&output_handler.burst, HEATER_OUTPUT_NUMBER, BURST_WINDOW_HALF_CYCLES, HEATER_OUTPUT_NUMBER);
+
+    for (heater_output_channel_t channel = 0; channel < HEATER_OUTPUT_NUMBER; channel++)
+    {
+        output_handler.duty[channel] = 0.0f;
+        output_handler.compare[channel] = 0;
+        output_handler.pin_on[channel] = false;
+        output_handler.counters[channel].on_time_ms = 0;
+        output_handler.counters[channel].switch_count = 0;
+
+        write_pin(channel, false);
+        __HAL_TIM_SET_COMPARE(&HEATER_TIMER_HANDLE, output_config[channel].timer_channel, 0);
+        channels_ok &= HAL_TIM_OC_Start_IT(&HEATER_TIMER_HANDLE, output_config[channel].timer_channel) == HAL_OK;
+    }
+
+    update_stop_inhibit();
+
+    bool base_ok = HAL_TIM_Base_Start_IT(&HEATER_TIMER_HANDLE) == HAL_OK;
+
+    return base_ok && channels_ok;
+}
+
+bool heater_output_set_mode(heater_output_mode_t mode)
+{
+    if (mode >= HEATER_OUTPUT_MODE_NUMBER)
+    {
+        return false;
+    }
+
+    uint32_t period = (mode == HEATER_OUTPUT_MODE_BURST_FIRE) ? HALF_CYCLE_TICKS : output_handler.slow_pwm_period;
+
+    taskENTER_CRITICAL();
+    output_handler.mode = mode;
+    output_handler.missed_zero_crosses = ZERO_CROSS_TIMEOUT_HALF_CYCLES;
+    __HAL_TIM_SET_AUTORELOAD(&HEATER_TIMER_HANDLE, period - 1);
+    __HAL_TIM_SET_COUNTER(&HEATER_TIMER_HANDLE, 0);
+
+    for (heater_output_channel_t channel = 0; channel < HEATER_OUTPUT_NUMBER; channel++)
+    {
+        /* Burst fire switches on the update event only, its compare channels never match. */
+        uint32_t compare = (mode == HEATER_OUTPUT_MODE_BURST_FIRE) ? period + 1 : duty_to_compare(output_handler.duty[channel], period);
+
+        output_handler.compare[channel] = compare;
+        __HAL_TIM_SET_COMPARE(&HEATER_TIMER_HANDLE, output_config[channel].timer_channel, compare);
+        burst_fire_set_duty(&output_handler.burst, channel, output_handler.duty[channel]);
+        write_pin(channel, mode == HEATER_OUTPUT_MODE_SLOW_PWM && compare > 0);
+    }
+    taskEXIT_CRITICAL();
+
+    return true;
+}
+
+heater_output_mode_t heater_output_get_mode(void)
+{
+    return output_handler.mode;
+}
+
+void heater_output_set_max_simultaneous(uint8_t max_simultaneous)
+{
+    if (max_simultaneous == 0 || max_simultaneous > HEATER_OUTPUT_NUMBER)
+    {
+        max_simultaneous = HEATER_OUTPUT_NUMBER;
+    }
+
+    taskENTER_CRITICAL();
+    burst_fire_set_max_simultaneous(&output_handler.burst, max_simultaneous);
+    taskEXIT_CRITICAL();
+}
+
+bool heater_output_zero_cross_present(void)
+{
+    return output_handler.missed_zero_crosses < ZERO_CROSS_TIMEOUT_HALF_CYCLES;
+}
+
+void heater_output_set_duty(heater_output_channel_t channel, float duty_percent)
+{
+    if (channel >= HEATER_OUTPUT_NUMBER)
+    {
+        return;
+    }
+
+    /* A NaN or infinite duty from a broken computation switches the output off. */
+    if (!isfinite(duty_percent)) duty_percent = 0.0f;
+    if (duty_percent < 0.0f) duty_percent = 0.0f;
+    if (duty_percent > 100.0f) duty_percent = 100.0f;
+
+    taskENTER_CRITICAL();
+    output_handler.duty[channel] = duty_percent;
+
+    if (output_handler.mode == HEATER_OUTPUT_MODE_BURST_FIRE)
+    {
+        burst_fire_set_duty(&output_handler.burst, channel, duty_percent);
+    }
+    else
+    {
+        uint32_t compare = duty_to_compare(duty_percent, __HAL_TIM_GET_AUTORELOAD(&HEATER_TIMER_HANDLE) + 1);
+
+        output_handler.compare[channel] = compare;
+        __HAL_TIM_SET_COMPARE(&HEATER_TIMER_HANDLE, output_config[channel].timer_channel, compare);
+        write_pin(channel, __HAL_TIM_GET_COUNTER(&HEATER_TIMER_HANDLE) < compare);
+    }
+
+    update_stop_inhibit();
+    taskEXIT_CRITICAL();
+}
+
+float heater_output_get_duty(heater_output_channel_t channel)
+{
+    return (channel < HEATER_OUTPUT_NUMBER) ? output_handler.duty[channel] : 0.0f;
+}
+
+bool heater_output_is_on(heater_output_channel_t channel)
+{
+    if (channel >= HEATER_OUTPUT_NUMBER)
+    {
+        return false;
+    }
+
+    return HAL_GPIO_ReadPin(output_config[channel].port, output_config[channel].pin) == GPIO_PIN_SET;
+}
+
+/* On-time includes the pulse in progress. */
+bool heater_output_get_counters(heater_output_channel_t channel, heater_output_counters_t *counters)
+{
+    if (channel >= HEATER_OUTPUT_NUMBER)
+    {
+        return false;
+    }
+
+    taskENTER_CRITICAL();
+    *counters = output_handler.counters[channel];
+    if (output_handler.pin_on[channel])
+    {
+        counters->on_time_ms += HAL_GetTick() - output_handler.on_since_ms[channel];
+    }
+    taskEXIT_CRITICAL();
+
+    return true;
+}
+
+void heater_output_period_elapsed(TIM_HandleTypeDef *htim)
+{
+    if (htim->Instance != HEATER_TIMER_HANDLE.Instance)
+    {
+        return;
+    }
+
+    if (output_handler.mode == HEATER_OUTPUT_MODE_BURST_FIRE)
+    {
+        /* While zero-cross edges arrive they pace the scheduler; the timer only counts missing ones. */
+        if (output_handler.missed_zero_crosses < ZERO_CROSS_TIMEOUT_HALF_CYCLES)
+        {
+            output_handler.missed_zero_crosses++;
+        }
+        else
+        {
+            burst_step();
+        }
+
+        return;
+    }
+
+    for (heater_output_channel_t channel = 0; channel < HEATER_OUTPUT_NUMBER; channel++)
+    {
+        write_pin(channel, output_handler.compare[channel] > 0);
+    }
+}
+
+void heater_output_zero_cross(uint16_t GPIO_Pin)
+{
+    if (GPIO_Pin != ZERO_CROSS_Pin || output_handler.mode != HEATER_OUTPUT_MODE_BURST_FIRE)
+    {
+        return;
+    }
+
+    __HAL_TIM_SET_COUNTER(&HEATER_TIMER_HANDLE, 0);
+    output_handler.missed_zero_crosses = 0;
+    burst_step();
+}
+
+void HAL_TIM_OC_DelayElapsedCallback(TIM_HandleTypeDef *htim)
+{
+    if (htim->Instance != HEATER_TIMER_HANDLE.Instance || output_handler.mode != HEATER_OUTPUT_MODE_SLOW_PWM)
+    {
+        return;
+    }
+
+    for (heater_output_channel_t channel = 0; channel < HEATER_OUTPUT_NUMBER; channel++)
+    {
+        if (htim->Channel == output_config[channel].active_channel)
+        {
+            write_pin(channel, false);
+        }
+    }
+}
+
+static uint32_t duty_to_compare(float duty_percent, uint32_t period)
+{
+    uint32_t compare = (uint32_t)(duty_percent * period / 100.0f);
+
+    if (compare > 0 && compare < MIN_HEATER_TIME_MS * TIMER_TICKS_PER_MS)
+    {
+        compare = MIN_HEATER_TIME_MS * TIMER_TICKS_PER_MS;
+    }
+
+    /* A compare value past the auto-reload never matches, the output stays on. */
+    if (compare >= period)
+    {
+        compare = period + 1;
+    }
+
+    return compare;
+}
+
+static void burst_step(void)
+{
+    uint32_t mask = burst_fire_next_half_cycle(&output_handler.burst);
+
+    for (heater_output_channel_t channel = 0; channel < HEATER_OUTPUT_NUMBER; channel++)
+    {
+        write_pin(channel, (mask & (1u << channel)) != 0);
+    }
+}
+
+/* Called with interrupts masked or from the TIM3/EXTI interrupts. */
+static void write_pin(heater_output_channel_t channel, bool on)
+{
+    if (on != output_handler.pin_on[channel])
+    {
+        uint32_t now = HAL_GetTick();
+
+        if (on)
+        {
+            output_handler.on_since_ms[channel] = now;
+            output_handler.counters[channel].switch_count++;
+        }
+        else
+        {
+            output_handler.counters[channel].on_time_ms += now - output_handler.on_since_ms[channel];
+        }
+
+        output_handler.pin_on[channel] = on;
+    }
+
+    HAL_GPIO_WritePin(output_config[channel].port, output_config[channel].pin, on ? GPIO_PIN_SET : GPIO_PIN_RESET);
+}
+
+static void update_stop_inhibit(void)
+{
+    bool active = false;
+
+    for (heater_output_channel_t channel = 0; channel < HEATER_OUTPUT_NUMBER; channel++)
+    {
+        active |= output_handler.duty[channel] > 0.0f;
+    }
+
+    low_power_inhibit_stop(LOW_POWER_INHIBIT_HEATER, active);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include "stm32l4xx_hal.h"
+
+typedef enum
+{
+    HEATER_OUTPUT_1,
+    HEATER_OUTPUT_2,
+
+    HEATER_OUTPUT_NUMBER,
+} heater_output_channel_t;
+
+typedef enum
+{
+    HEATER_OUTPUT_MODE_SLOW_PWM,
+    HEATER_OUTPUT_MODE_BURST_FIRE,
+
+    HEATER_OUTPUT_MODE_NUMBER,
+} heater_output_mode_t;
+
+typedef struct
+{
+    uint64_t on_time_ms;
+    uint32_t switch_count;
+} heater_output_counters_t;
+
+bool heater_output_init(void);
+bool heater_output_set_mode(heater_output_mode_t mode);
+heater_output_mode_t heater_output_get_mode(void);
+void heater_output_set_max_simultaneous(uint8_t max_simultaneous);
+bool heater_output_zero_cross_present(void);
+void heater_output_set_duty(heater_output_channel_t channel, float duty_percent);
+float heater_output_get_duty(heater_output_channel_t channel);
+bool heater_output_is_on(heater_output_channel_t channel);
+bool heater_output_get_counters(heater_output_channel_t channel, heater_output_counters_t *counters);
+void heater_output_period_elapsed(TIM_HandleTypeDef *htim);
+void heater_output_zero_cross(uint16_t GPIO_Pin);
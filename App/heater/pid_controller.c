@@ -0,0 +1,284 @@
+/**
+ * PID control law, free of RTOS and HAL dependencies so it can also be
+ * linked into the host simulator
+ *
+ * The derivative acts on the measurement through a first-order filter with
+ * time constant kd / (kp * derivative_filter), so setpoint steps do not kick
+ * the output. The integral is kept in output units and is corrected by
+ * back-calculation whenever the output saturates, which also makes gain
+ * changes and hand-overs from other modes bumpless. An optional
+ * feedforward term is added before saturation.
+ *
+ * Gains can be scheduled from a table of gain sets sorted by temperature,
+ * looked up by setpoint or measurement and interpolated linearly between
+ * neighbouring entries.
+ */
+
+#include "pid_controller.h"
+
+#include <math.h>
+#include <stddef.h>
+
+static float clamp_output(float value);
+static float clamp_integral(float value);
+static float tracking_time(const pid_parameters_t *pid);
+static void scheduled_gains(const pid_parameters_t *pid, float temperature, pid_gain_set_t *gains);
+
+void pid_controller_init(pid_parameters_t *pid, float kp, float ki, float kd)
+{
+    pid->kp = kp;
+    pid->ki = ki;
+    pid->kd = kd;
+    pid->derivative_filter = PID_CONTROLLER_DEFAULT_DERIVATIVE_FILTER;
+    pid->schedule_source = PID_SCHEDULE_OFF;
+    pid->gain_count = 0;
+
+    pid->feedforward = 0.0f;
+    pid->integral = 0.0f;
+    pid->derivative = 0.0f;
+    pid->previous_error = 0.0f;
+    pid->previous_temperature = 0.0f;
+    pid->current_power = 0.0f;
+    pid->initialized = false;
+}
+
+float pid_controller_update(pid_parameters_t *pid, float current_temperature, float dt)
+{
+    float error = pid->setpoint - current_temperature;
+
+    if (pid->schedule_source != PID_SCHEDULE_OFF && pid->gain_count > 0)
+    {
+        pid_gain_set_t gains;
+        float temperature = (pid->schedule_source == PID_SCHEDULE_SETPOINT) ? pid->setpoint : current_temperature;
+
+        scheduled_gains(pid, temperature, &gains);
+        pid_controller_set_gains(pid, gains.kp, gains.ki, gains.kd);
+    }
+
+    if (!pid->initialized)
+    {
+        /* Start from the output the previous mode left behind. */
+        pid->derivative = 0.0f;
+        pid->previous_temperature = current_temperature;
+        pid->integral = clamp_integral(pid->current_power - pid->kp * error - pid->feedforward);
+        pid->initialized = true;
+    }
+
+    if (pid->kd > 0.0f && dt > 0.0f)
+    {
+        float filter_time = (pid->kp > 0.0f && pid->derivative_filter > 0.0f) ? pid->kd / (pid->kp * pid->derivative_filter) : 0.0f;
+        float slope = (current_temperature - pid->previous_temperature) / dt;
+
+        pid->derivative += (dt / (filter_time + dt)) * (slope - pid->derivative);
+    }
+    else
+    {
+        pid->derivative = 0.0f;
+    }
+
+    float unsaturated = pid->kp * error + pid->integral + pid->feedforward - pid->kd * pid->derivative;
+    float output = clamp_output(unsaturated);
+
+    if (pid->ki > 0.0f)
+    {
+        float tracking = dt / tracking_time(pid);
+
+        if (tracking > 1.0f)
+        {
+            tracking = 1.0f;
+        }
+
+        pid->integral += pid->ki * error * dt + (output - unsaturated) * tracking;
+        pid->integral = clamp_integral(pid->integral);
+    }
+
+    pid->current_power = output;
+    pid->previous_error = error;
+    pid->previous_temperature = current_temperature;
+
+    return output;
+}
+
+void pid_controller_set_gains(pid_parameters_t *pid, float kp, float ki, float kd)
+{
+    if (pid->initialized)
+    {
+        /* Shift the integral so the last output is reproduced with the new gains. */
+        pid->integral += (pid->kp - kp) * pid->previous_error - (pid->kd - kd) * pid->derivative;
+        pid->integral = clamp_integral(pid->integral);
+    }
+
+    pid->kp = kp;
+    pid->ki = ki;
+    pid->kd = kd;
+}
+
+/* Infinite gains would turn a zero error term into a NaN output. */
+bool pid_controller_gains_valid(float kp, float ki, float kd)
+{
+    return isfinite(kp) && isfinite(ki) && isfinite(kd) && kp >= 0.0f && ki >= 0.0f && kd >= 0.0f;
+}
+
+/* Back-calculation against a limit applied after the controller, e.g. a shared power cap. */
+void pid_controller_track_output(pid_parameters_t *pid, float applied_output, float dt)
+{
+    if (pid->ki > 0.0f && dt > 0.0f)
+    {
+        float tracking = dt / tracking_time(pid);
+
+        if (tracking > 1.0f)
+        {
+            tracking = 1.0f;
+        }
+
+        pid->integral = clamp_integral(pid->integral + (applied_output - pid->current_power) * tracking);
+    }
+
+    pid->current_power = clamp_output(applied_output);
+}
+
+void pid_controller_transfer(pid_parameters_t *pid, float output)
+{
+    pid->current_power = clamp_output(output);
+    pid->initialized = false;
+}
+
+bool pid_controller_set_schedule(pid_parameters_t *pid, const pid_gain_set_t *table, uint8_t count, pid_schedule_source_t source)
+{
+    if (source >= PID_SCHEDULE_NUMBER || count > PID_CONTROLLER_MAX_GAIN_SETS || (count > 0 && table == NULL))
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (!pid_controller_gains_valid(table[i].kp, table[i].ki, table[i].kd) || !isfinite(table[i].temperature))
+        {
+            return false;
+        }
+
+        if (i > 0 && table[i].temperature <= table[i - 1].temperature)
+        {
+            return false;
+        }
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        pid->gain_table[i] = table[i];
+    }
+
+    pid->gain_count = count;
+    pid->schedule_source = (count > 0) ? source : PID_SCHEDULE_OFF;
+
+    return true;
+}
+
+/* Inserts a gain set in temperature order, replacing an entry within 1 degree or the nearest one when full. */
+bool pid_controller_store_gain_set(pid_parameters_t *pid, const pid_gain_set_t *gain_set)
+{
+    if (!pid_controller_gains_valid(gain_set->kp, gain_set->ki, gain_set->kd) || !isfinite(gain_set->temperature))
+    {
+        return false;
+    }
+
+    uint8_t nearest = 0;
+
+    for (uint8_t i = 1; i < pid->gain_count; i++)
+    {
+        if (fabsf(pid->gain_table[i].temperature - gain_set->temperature) < fabsf(pid->gain_table[nearest].temperature - gain_set->temperature))
+        {
+            nearest = i;
+        }
+    }
+
+    bool replace = (pid->gain_count == PID_CONTROLLER_MAX_GAIN_SETS) ||
+                   (pid->gain_count > 0 && fabsf(pid->gain_table[nearest].temperature - gain_set->temperature) < 1.0f);
+
+    if (replace)
+    {
+        /* Remove the replaced entry, then insert below. */
+        for (uint8_t i = nearest; i + 1 < pid->gain_count; i++)
+        {
+            pid->gain_table[i] = pid->gain_table[i + 1];
+        }
+        pid->gain_count--;
+    }
+
+    uint8_t position = pid->gain_count;
+
+    while (position > 0 && pid->gain_table[position - 1].temperature > gain_set->temperature)
+    {
+        pid->gain_table[position] = pid->gain_table[position - 1];
+        position--;
+    }
+
+    pid->gain_table[position] = *gain_set;
+    pid->gain_count++;
+
+    return true;
+}
+
+static float clamp_output(float value)
+{
+    if (value > PID_CONTROLLER_OUTPUT_MAX) return PID_CONTROLLER_OUTPUT_MAX;
+    if (value < PID_CONTROLLER_OUTPUT_MIN) return PID_CONTROLLER_OUTPUT_MIN;
+    return value;
+}
+
+/* The integral may go negative to offset an oversized feedforward. */
+static float clamp_integral(float value)
+{
+    float limit = PID_CONTROLLER_OUTPUT_MAX - PID_CONTROLLER_OUTPUT_MIN;
+
+    if (value > limit) return limit;
+    if (value < -limit) return -limit;
+    return value;
+}
+
+/* Back-calculation time constant: sqrt(Ti * Td), or Ti for a PI controller. */
+static float tracking_time(const pid_parameters_t *pid)
+{
+    float integral_time = (pid->kp > 0.0f) ? pid->kp / pid->ki : 1.0f / pid->ki;
+
+    if (pid->kd > 0.0f && pid->kp > 0.0f)
+    {
+        return sqrtf(integral_time * pid->kd / pid->kp);
+    }
+
+    return integral_time;
+}
+
+/* Linear interpolation between the bands around temperature, held at the ends of the table. */
+static void scheduled_gains(const pid_parameters_t *pid, float temperature, pid_gain_set_t *gains)
+{
+    const pid_gain_set_t *table = pid->gain_table;
+    uint8_t last = pid->gain_count - 1;
+
+    if (temperature <= table[0].temperature || isnan(temperature))
+    {
+        *gains = table[0];
+        return;
+    }
+
+    if (temperature >= table[last].temperature)
+    {
+        *gains = table[last];
+        return;
+    }
+
+    uint8_t upper = 1;
+    while (table[upper].temperature < temperature)
+    {
+        upper++;
+    }
+
+    const pid_gain_set_t *low = &table[upper - 1];
+    const pid_gain_set_t *high = &table[upper];
+    float fraction = (temperature - low->temperature) / (high->temperature - low->temperature);
+
+    gains->temperature = temperature;
+    gains->kp = low->kp + fraction * (high->kp - low->kp);
+    gains->ki = low->ki + fraction * (high->ki - low->ki);
+    gains->kd = low->kd + fraction * (high->kd - low->kd);
+}
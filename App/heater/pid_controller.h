@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PID_CONTROLLER_OUTPUT_MIN 0.0f
+#define PID_CONTROLLER_OUTPUT_MAX 100.0f
+#define PID_CONTROLLER_DEFAULT_DERIVATIVE_FILTER 10.0f
+#define PID_CONTROLLER_MAX_GAIN_SETS 8
+
+typedef enum
+{
+    PID_SCHEDULE_OFF,
+    PID_SCHEDULE_SETPOINT,
+    PID_SCHEDULE_MEASUREMENT,
+
+    PID_SCHEDULE_NUMBER,
+} pid_schedule_source_t;
+
+typedef struct
+{
+    float temperature;
+    float kp;
+    float ki;
+    float kd;
+} pid_gain_set_t;
+
+typedef struct
+{
+    float kp;
+    float ki;
+    float kd;
+    float derivative_filter;
+
+    pid_schedule_source_t schedule_source;
+    pid_gain_set_t gain_table[PID_CONTROLLER_MAX_GAIN_SETS];
+    uint8_t gain_count;
+
+    float setpoint;
+    float feedforward;
+    float integral;
+    float derivative;
+    float previous_error;
+    float previous_temperature;
+    float current_power;
+    bool initialized;
+} pid_parameters_t;
+
+void pid_controller_init(pid_parameters_t *pid, float kp, float ki, float kd);
+float pid_controller_update(pid_parameters_t *pid, float current_temperature, float dt);
+void pid_controller_set_gains(pid_parameters_t *pid, float kp, float ki, float kd);
+bool pid_controller_gains_valid(float kp, float ki, float kd);
+void pid_controller_track_output(pid_parameters_t *pid, float applied_output, float dt);
+void pid_controller_transfer(pid_parameters_t *pid, float output);
+
+bool pid_controller_set_schedule(pid_parameters_t *pid, const pid_gain_set_t *table, uint8_t count, pid_schedule_source_t source);
+bool pid_controller_store_gain_set(pid_parameters_t *pid, const pid_gain_set_t *gain_set);
@@ -0,0 +1,193 @@
+/**
+ * Ramp/soak setpoint program engine
+ *
+ * Executes a list of segments and produces a smoothly moving setpoint.
+ * Segments advance on time (HOLD), on reaching their target (RAMP) or on
+ * the measured temperature entering a band around the setpoint (WAIT_BAND).
+ */
+
+#include "setpoint_program.h"
+
+#include <math.h>
+#include <stddef.h>
+
+static void enter_segment(setpoint_program_t *program, uint8_t segment);
+static bool run_segment(setpoint_program_t *program, float temperature, float dt);
+
+/* Targets above max_target, non-finite values and negative durations or bands are refused. */
+bool setpoint_program_validate(const setpoint_segment_t *segments, uint8_t segment_count, float max_target)
+{
+    if (segments == NULL || segment_count == 0 || segment_count > SETPOINT_PROGRAM_MAX_SEGMENTS)
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < segment_count; i++)
+    {
+        if (segments[i].type >= SETPOINT_SEGMENT_NUMBER)
+        {
+            return false;
+        }
+
+        if (segments[i].type == SETPOINT_SEGMENT_LOOP && segments[i].loop_to >= i)
+        {
+            return false;
+        }
+
+        if ((segments[i].type == SETPOINT_SEGMENT_STEP || segments[i].type == SETPOINT_SEGMENT_RAMP) &&
+            !(isfinite(segments[i].target) && segments[i].target <= max_target))
+        {
+            return false;
+        }
+
+        if (segments[i].type == SETPOINT_SEGMENT_RAMP && !(isfinite(segments[i].rate) && segments[i].rate > 0.0f))
+        {
+            return false;
+        }
+
+        if (!(isfinite(segments[i].duration_s) && segments[i].duration_s >= 0.0f && isfinite(segments[i].band) && segments[i].band >= 0.0f))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool setpoint_program_start(setpoint_program_t *program, const setpoint_segment_t *segments, uint8_t segment_count, float initial_setpoint,
+                            float max_target)
+{
+    if (!setpoint_program_validate(segments, segment_count, max_target))
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < segment_count; i++)
+    {
+        program->segments[i] = segments[i];
+        program->loops_remaining[i] = segments[i].loop_count;
+    }
+
+    program->segment_count = segment_count;
+    program->setpoint = initial_setpoint;
+    program->elapsed = 0.0f;
+    program->running = true;
+    enter_segment(program, 0);
+
+    return true;
+}
+
+void setpoint_program_stop(setpoint_program_t *program)
+{
+    program->running = false;
+}
+
+float setpoint_program_update(setpoint_program_t *program, float temperature, float dt)
+{
+    if (!program->running)
+    {
+        return program->setpoint;
+    }
+
+    program->elapsed += dt;
+    program->segment_elapsed += dt;
+
+    /* Instantaneous segments (STEP, LOOP) chain within one update, bounded by the table size. */
+    for (uint8_t i = 0; i <= SETPOINT_PROGRAM_MAX_SEGMENTS && program->running; i++)
+    {
+        if (!run_segment(program, temperature, dt))
+        {
+            break;
+        }
+
+        dt = 0.0f;
+    }
+
+    return program->setpoint;
+}
+
+bool setpoint_program_is_running(const setpoint_program_t *program)
+{
+    return program->running;
+}
+
+static void enter_segment(setpoint_program_t *program, uint8_t segment)
+{
+    program->segment_elapsed = 0.0f;
+
+    if (segment >= program->segment_count)
+    {
+        program->running = false;
+        return;
+    }
+
+    program->segment = segment;
+}
+
+/* Returns true when the segment finished and the next one should run in the same update. */
+static bool run_segment(setpoint_program_t *program, float temperature, float dt)
+{
+    const setpoint_segment_t *segment = &program->segments[program->segment];
+    uint8_t next = program->segment + 1;
+
+    switch (segment->type)
+    {
+        case SETPOINT_SEGMENT_STEP:
+            program->setpoint = segment->target;
+            break;
+
+        case SETPOINT_SEGMENT_RAMP:
+        {
+            float step = segment->rate * dt / 60.0f;
+            float remaining = segment->target - program->setpoint;
+
+            if (fabsf(remaining) > step)
+            {
+                program->setpoint += (remaining > 0.0f) ? step : -step;
+                return false;
+            }
+
+            program->setpoint = segment->target;
+            break;
+        }
+
+        case SETPOINT_SEGMENT_HOLD:
+            if (program->segment_elapsed < segment->duration_s)
+            {
+                return false;
+            }
+            break;
+
+        case SETPOINT_SEGMENT_WAIT_BAND:
+        {
+            bool in_band = !isnan(temperature) && fabsf(temperature - program->setpoint) <= segment->band;
+            bool timed_out = segment->duration_s > 0.0f && program->segment_elapsed >= segment->duration_s;
+
+            if (!in_band && !timed_out)
+            {
+                return false;
+            }
+            break;
+        }
+
+        case SETPOINT_SEGMENT_LOOP:
+            if (program->loops_remaining[program->segment] > 0)
+            {
+                program->loops_remaining[program->segment]--;
+                next = segment->loop_to;
+            }
+            else
+            {
+                program->loops_remaining[program->segment] = segment->loop_count;
+            }
+            break;
+
+        default:
+            program->running = false;
+            return false;
+    }
+
+    enter_segment(program, next);
+
+    return true;
+}
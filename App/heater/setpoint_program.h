@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SETPOINT_PROGRAM_MAX_SEGMENTS 16
+
+typedef enum
+{
+    SETPOINT_SEGMENT_STEP,
+    SETPOINT_SEGMENT_RAMP,
+    SETPOINT_SEGMENT_HOLD,
+    SETPOINT_SEGMENT_WAIT_BAND,
+    SETPOINT_SEGMENT_LOOP,
+
+    SETPOINT_SEGMENT_NUMBER,
+} setpoint_segment_type_t;
+
+typedef struct
+{
+    setpoint_segment_type_t type;
+    float target;       /* STEP, RAMP: C */
+    float rate;         /* RAMP: C/min */
+    float duration_s;   /* HOLD: soak time, WAIT_BAND: timeout (0 = none) */
+    float band;         /* WAIT_BAND: C */
+    uint8_t loop_to;    /* LOOP: segment index to jump back to */
+    uint8_t loop_count; /* LOOP: number of repetitions */
+} setpoint_segment_t;
+
+typedef struct
+{
+    setpoint_segment_t segments[SETPOINT_PROGRAM_MAX_SEGMENTS];
+    uint8_t loops_remaining[SETPOINT_PROGRAM_MAX_SEGMENTS];
+    uint8_t segment_count;
+
+    bool running;
+    uint8_t segment;
+    float segment_elapsed;
+    float elapsed;
+    float setpoint;
+} setpoint_program_t;
+
+bool setpoint_program_validate(const setpoint_segment_t *segments, uint8_t segment_count, float max_target);
+bool setpoint_program_start(setpoint_program_t *program, const setpoint_segment_t *segments, uint8_t segment_count, float initial_setpoint,
+                            float max_target);
+void setpoint_program_stop(setpoint_program_t *program);
+float setpoint_program_update(setpoint_program_t *program, float temperature, float dt);
+bool setpoint_program_is_running(const setpoint_program_t *program);
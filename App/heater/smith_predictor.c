@@ -0,0 +1,149 @@
+/**
+ * Smith predictor with first-order-plus-dead-time model feedforward
+ *
+ * The PI controller acts on the measurement corrected by the difference
+ * between the delay-free and the delayed model response, so it can be tuned
+ * for the lag alone. Setpoint changes are shaped by a first-order reference
+ * filter and fed forward through the inverse model. When the auto-tuner
+ * could only identify an integrating model, the predictor uses a leaky model
+ * with time constant 8 * dead_time and drops the static feedforward term.
+ */
+
+#include "smith_predictor.h"
+
+#include <math.h>
+#include <stddef.h>
+
+#define INTEGRATING_TIME_CONSTANT_FACTOR 8.0f
+
+static void reset_model(smith_predictor_t *predictor, float value);
+static float delayed_model_output(smith_predictor_t *predictor, float dt);
+
+bool smith_predictor_init(smith_predictor_t *predictor, const fopdt_model_t *model, float closed_loop_time)
+{
+    predictor->valid = false;
+
+    if (model == NULL || model->dead_time < 0.0f)
+    {
+        return false;
+    }
+
+    if (model->process_gain > 0.0f && model->time_constant > 0.0f)
+    {
+        predictor->model_gain = model->process_gain;
+        predictor->model_time_constant = model->time_constant;
+    }
+    else if (model->integrating_gain > 0.0f && model->dead_time > 0.0f)
+    {
+        predictor->model_time_constant = INTEGRATING_TIME_CONSTANT_FACTOR * model->dead_time;
+        predictor->model_gain = model->integrating_gain * predictor->model_time_constant;
+    }
+    else
+    {
+        return false;
+    }
+
+    predictor->model = *model;
+    predictor->closed_loop_time = (closed_loop_time > 0.0f) ? closed_loop_time : fmaxf(model->dead_time, 1.0f);
+
+    /* SIMC tuning for the delay-free part of the model. */
+    float kp = predictor->model_time_constant / (predictor->model_gain * predictor->closed_loop_time);
+    float ti = fminf(predictor->model_time_constant, 4.0f * predictor->closed_loop_time);
+
+    pid_controller_init(&predictor->pid, kp, kp / ti, 0.0f);
+
+    predictor->slot_period = model->dead_time / (SMITH_PREDICTOR_DELAY_SLOTS - 1);
+    reset_model(predictor, 0.0f);
+    predictor->reference = 0.0f;
+    predictor->reference_origin = 0.0f;
+    predictor->valid = true;
+
+    return true;
+}
+
+bool smith_predictor_model_from_autotune(const autotune_result_t *result, fopdt_model_t *model)
+{
+    if (result->dead_time <= 0.0f || (result->integrating_gain <= 0.0f && result->process_gain <= 0.0f))
+    {
+        return false;
+    }
+
+    model->process_gain = result->process_gain;
+    model->integrating_gain = result->integrating_gain;
+    model->time_constant = result->time_constant;
+    model->dead_time = result->dead_time;
+
+    return true;
+}
+
+void smith_predictor_transfer(smith_predictor_t *predictor, float setpoint, float output)
+{
+    /* Start the model in equilibrium with the current output. */
+    reset_model(predictor, predictor->model_gain * output);
+    predictor->reference = setpoint;
+    predictor->reference_origin = setpoint;
+    predictor->pid.feedforward = 0.0f;
+    pid_controller_transfer(&predictor->pid, output);
+}
+
+float smith_predictor_update(smith_predictor_t *predictor, float setpoint, float current_temperature, float dt)
+{
+    if (!predictor->valid || dt <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    /* Advance the model with the output applied over the last period. */
+    float decay = 1.0f - expf(-dt / predictor->model_time_constant);
+    predictor->undelayed += decay * (predictor->model_gain * predictor->pid.current_power - predictor->undelayed);
+
+    float predicted = current_temperature + predictor->undelayed - delayed_model_output(predictor, dt);
+
+    predictor->reference += (1.0f - expf(-dt / predictor->closed_loop_time)) * (setpoint - predictor->reference);
+    float reference_rate = (setpoint - predictor->reference) / predictor->closed_loop_time;
+
+    float feedforward = predictor->model_time_constant * reference_rate / predictor->model_gain;
+    if (predictor->model.time_constant > 0.0f)
+    {
+        feedforward += (predictor->reference - predictor->reference_origin) / predictor->model_gain;
+    }
+
+    predictor->pid.setpoint = setpoint;
+    predictor->pid.feedforward = feedforward;
+
+    return pid_controller_update(&predictor->pid, predicted, dt);
+}
+
+static void reset_model(smith_predictor_t *predictor, float value)
+{
+    predictor->undelayed = value;
+    predictor->delay_head = 0;
+    predictor->slot_elapsed = 0.0f;
+
+    for (uint8_t i = 0; i < SMITH_PREDICTOR_DELAY_SLOTS; i++)
+    {
+        predictor->delay_line[i] = value;
+    }
+}
+
+/* Returns the delay-free model output from dead_time ago, interpolated between slots. */
+static float delayed_model_output(smith_predictor_t *predictor, float dt)
+{
+    if (predictor->slot_period <= 0.0f)
+    {
+        return predictor->undelayed;
+    }
+
+    predictor->slot_elapsed += dt;
+    while (predictor->slot_elapsed >= predictor->slot_period)
+    {
+        predictor->delay_line[predictor->delay_head] = predictor->undelayed;
+        predictor->delay_head = (predictor->delay_head + 1) % SMITH_PREDICTOR_DELAY_SLOTS;
+        predictor->slot_elapsed -= predictor->slot_period;
+    }
+
+    float oldest = predictor->delay_line[predictor->delay_head];
+    float next = predictor->delay_line[(predictor->delay_head + 1) % SMITH_PREDICTOR_DELAY_SLOTS];
+
+    return oldest + (next - oldest) * (predictor->slot_elapsed / predictor->slot_period);
+}
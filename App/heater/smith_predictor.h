@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pid_controller.h"
+#include "autotune.h"
+
+#define SMITH_PREDICTOR_DELAY_SLOTS 32
+
+typedef struct
+{
+    float process_gain;
+    float integrating_gain;
+    float time_constant;
+    float dead_time;
+} fopdt_model_t;
+
+typedef struct
+{
+    fopdt_model_t model;
+    float closed_loop_time;
+    float model_gain;
+    float model_time_constant;
+    bool valid;
+
+    pid_parameters_t pid;
+
+    float undelayed;
+    float delay_line[SMITH_PREDICTOR_DELAY_SLOTS];
+    uint8_t delay_head;
+    float slot_period;
+    float slot_elapsed;
+
+    float reference;
+    float reference_origin;
+} smith_predictor_t;
+
+bool smith_predictor_init(smith_predictor_t *predictor, const fopdt_model_t *model, float closed_loop_time);
+bool smith_predictor_model_from_autotune(const autotune_result_t *result, fopdt_model_t *model);
+void smith_predictor_transfer(smith_predictor_t *predictor, float setpoint, float output);
+float smith_predictor_update(smith_predictor_t *predictor, float setpoint, float current_temperature, float dt);
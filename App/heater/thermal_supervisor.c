@@ -0,0 +1,238 @@
+/**
+ * Thermal supervisor: sensor plausibility and heater runaway detection
+ *
+ * Runs once per control cycle next to the controller and latches the first
+ * fault it sees until it is cleared explicitly:
+ * - stale: no valid sample for stale_time,
+ * - stuck: the reading does not change at all while the heater is driven
+ *   near full power,
+ * - implausible slope: a step between samples faster than the chamber can
+ *   physically move,
+ * - over-temperature,
+ * - runaway: over each window the temperature rose far less than a
+ *   first-order model of the chamber predicts for the applied power, or,
+ *   while the heater is driven near full power, it fell from its peak.
+ *
+ * The default model parameters are deliberately pessimistic (slow heating,
+ * fast losses) so a healthy chamber never trips; an identified FOPDT model
+ * sharpens the runaway check.
+ */
+
+#include "thermal_supervisor.h"
+
+#include <math.h>
+#include <stddef.h>
+
+#define SATURATED_POWER 90.0f
+
+static const thermal_supervisor_config_t default_config =
+{
+    .heating_rate = THERMAL_SUPERVISOR_DEFAULT_HEATING_RATE,
+    .loss_time_constant = THERMAL_SUPERVISOR_DEFAULT_LOSS_TIME_CONSTANT,
+    .ambient = THERMAL_SUPERVISOR_DEFAULT_AMBIENT,
+    .max_temperature = THERMAL_SUPERVISOR_DEFAULT_MAX_TEMPERATURE,
+
+    .stale_time = 5.0f,
+    .stuck_time = 60.0f,
+    .max_slope = 1.0f,
+    .slope_margin = 1.0f,
+
+    .runaway_window = 120.0f,
+    .runaway_min_expected_rise = 3.0f,
+    .runaway_min_rise_fraction = 0.3f,
+    .runaway_max_fall = 2.0f,
+};
+
+static const char *const fault_names[THERMAL_FAULT_NUMBER] =
+{
+    [THERMAL_FAULT_NONE] = "none",
+    [THERMAL_FAULT_SENSOR_STALE] = "sensor stale",
+    [THERMAL_FAULT_SENSOR_STUCK] = "sensor stuck",
+    [THERMAL_FAULT_IMPLAUSIBLE_SLOPE] = "implausible slope",
+    [THERMAL_FAULT_OVER_TEMPERATURE] = "over-temperature",
+    [THERMAL_FAULT_RUNAWAY] = "runaway",
+};
+
+static void restart_window(thermal_supervisor_t *supervisor, float temperature);
+static thermal_fault_t check_window(thermal_supervisor_t *supervisor, float temperature, float power, float dt);
+
+void thermal_supervisor_init(thermal_supervisor_t *supervisor, const thermal_supervisor_config_t *config)
+{
+    supervisor->config = (config != NULL) ? *config : default_config;
+    supervisor->fault = THERMAL_FAULT_NONE;
+    supervisor->has_previous = false;
+    supervisor->lowest_temperature = supervisor->config.ambient;
+    supervisor->stuck_elapsed = 0.0f;
+    restart_window(supervisor, NAN);
+}
+
+/* Derives the heating rate and loss time constant of the expected-rise model from an identified plant. */
+bool thermal_supervisor_set_model(thermal_supervisor_t *supervisor, const fopdt_model_t *model)
+{
+    if (model->process_gain > 0.0f && model->time_constant > 0.0f)
+    {
+        supervisor->config.heating_rate = model->process_gain * 100.0f / model->time_constant;
+        supervisor->config.loss_time_constant = model->time_constant;
+        return true;
+    }
+
+    /* An integrating model says nothing about losses, the default estimate stays. */
+    if (model->integrating_gain > 0.0f)
+    {
+        supervisor->config.heating_rate = model->integrating_gain * 100.0f;
+        return true;
+    }
+
+    return false;
+}
+
+/* power is the output applied over the last dt; armed is false while the heater is meant to be off. */
+thermal_fault_t thermal_supervisor_update(thermal_supervisor_t *supervisor, float temperature, float sample_age, float power, bool armed, float dt)
+{
+    const thermal_supervisor_config_t *config = &supervisor->config;
+    thermal_fault_t fault = THERMAL_FAULT_NONE;
+
+    if (supervisor->fault != THERMAL_FAULT_NONE)
+    {
+        return supervisor->fault;
+    }
+
+    if (isnan(temperature))
+    {
+        if (armed && sample_age > config->stale_time)
+        {
+            supervisor->fault = THERMAL_FAULT_SENSOR_STALE;
+        }
+
+        return supervisor->fault;
+    }
+
+    if (temperature < supervisor->lowest_temperature)
+    {
+        supervisor->lowest_temperature = temperature;
+    }
+
+    if (!armed)
+    {
+        supervisor->stuck_elapsed = 0.0f;
+        supervisor->saturated_peak = temperature;
+        restart_window(supervisor, temperature);
+    }
+    else if (sample_age > config->stale_time)
+    {
+        fault = THERMAL_FAULT_SENSOR_STALE;
+    }
+    else if (temperature > config->max_temperature)
+    {
+        fault = THERMAL_FAULT_OVER_TEMPERATURE;
+    }
+    else if (supervisor->has_previous && fabsf(temperature - supervisor->previous_temperature) > config->max_slope * dt + config->slope_margin)
+    {
+        fault = THERMAL_FAULT_IMPLAUSIBLE_SLOPE;
+    }
+    else
+    {
+        bool unchanged = supervisor->has_previous && temperature == supervisor->previous_temperature;
+
+        supervisor->stuck_elapsed = (unchanged && power >= SATURATED_POWER) ? supervisor->stuck_elapsed + dt : 0.0f;
+
+        if (supervisor->stuck_elapsed >= config->stuck_time)
+        {
+            fault = THERMAL_FAULT_SENSOR_STUCK;
+        }
+        else
+        {
+            fault = check_window(supervisor, temperature, power, dt);
+        }
+    }
+
+    supervisor->previous_temperature = temperature;
+    supervisor->has_previous = true;
+    supervisor->fault = fault;
+
+    return fault;
+}
+
+thermal_fault_t thermal_supervisor_get_fault(const thermal_supervisor_t *supervisor)
+{
+    return supervisor->fault;
+}
+
+void thermal_supervisor_clear_fault(thermal_supervisor_t *supervisor)
+{
+    supervisor->fault = THERMAL_FAULT_NONE;
+    supervisor->has_previous = false;
+    supervisor->stuck_elapsed = 0.0f;
+    restart_window(supervisor, NAN);
+}
+
+/* Re-latches a fault carried over a reset. */
+void thermal_supervisor_latch_fault(thermal_supervisor_t *supervisor, thermal_fault_t fault)
+{
+    if (fault < THERMAL_FAULT_NUMBER)
+    {
+        supervisor->fault = fault;
+    }
+}
+
+const char *thermal_supervisor_fault_name(thermal_fault_t fault)
+{
+    return (fault < THERMAL_FAULT_NUMBER) ? fault_names[fault] : "unknown";
+}
+
+static void restart_window(thermal_supervisor_t *supervisor, float temperature)
+{
+    supervisor->window_elapsed = 0.0f;
+    supervisor->window_start_temperature = temperature;
+    supervisor->window_expected_rise = 0.0f;
+}
+
+static thermal_fault_t check_window(thermal_supervisor_t *supervisor, float temperature, float power, float dt)
+{
+    const thermal_supervisor_config_t *config = &supervisor->config;
+
+    if (isnan(supervisor->window_start_temperature))
+    {
+        restart_window(supervisor, temperature);
+        supervisor->saturated_peak = temperature;
+        return THERMAL_FAULT_NONE;
+    }
+
+    /* The lowest reading bounds ambient from above, which keeps the loss estimate pessimistic. */
+    float ambient = fminf(config->ambient, supervisor->lowest_temperature);
+    float rate = power / 100.0f * config->heating_rate - (temperature - ambient) / config->loss_time_constant;
+
+    supervisor->window_expected_rise += rate * dt;
+    supervisor->window_elapsed += dt;
+
+    if (power >= SATURATED_POWER)
+    {
+        supervisor->saturated_peak = fmaxf(supervisor->saturated_peak, temperature);
+
+        if (supervisor->saturated_peak - temperature > config->runaway_max_fall)
+        {
+            return THERMAL_FAULT_RUNAWAY;
+        }
+    }
+    else
+    {
+        supervisor->saturated_peak = temperature;
+    }
+
+    if (supervisor->window_elapsed < config->runaway_window)
+    {
+        return THERMAL_FAULT_NONE;
+    }
+
+    float rise = temperature - supervisor->window_start_temperature;
+    thermal_fault_t fault = THERMAL_FAULT_NONE;
+
+    if (supervisor->window_expected_rise >= config->runaway_min_expected_rise && rise < config->runaway_min_rise_fraction * supervisor->window_expected_rise)
+    {
+        fault = THERMAL_FAULT_RUNAWAY;
+    }
+
+    restart_window(supervisor, temperature);
+
+    return fault;
+}
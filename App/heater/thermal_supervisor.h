@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "smith_predictor.h"
+
+#define THERMAL_SUPERVISOR_DEFAULT_HEATING_RATE 0.05f
+#define THERMAL_SUPERVISOR_DEFAULT_LOSS_TIME_CONSTANT 600.0f
+#define THERMAL_SUPERVISOR_DEFAULT_AMBIENT 20.0f
+#define THERMAL_SUPERVISOR_DEFAULT_MAX_TEMPERATURE 170.0f
+
+typedef enum
+{
+    THERMAL_FAULT_NONE,
+    THERMAL_FAULT_SENSOR_STALE,
+    THERMAL_FAULT_SENSOR_STUCK,
+    THERMAL_FAULT_IMPLAUSIBLE_SLOPE,
+    THERMAL_FAULT_OVER_TEMPERATURE,
+    THERMAL_FAULT_RUNAWAY,
+
+    THERMAL_FAULT_NUMBER,
+} thermal_fault_t;
+
+typedef struct
+{
+    float heating_rate;
+    float loss_time_constant;
+    float ambient;
+    float max_temperature;
+
+    float stale_time;
+    float stuck_time;
+    float max_slope;
+    float slope_margin;
+
+    float runaway_window;
+    float runaway_min_expected_rise;
+    float runaway_min_rise_fraction;
+    float runaway_max_fall;
+} thermal_supervisor_config_t;
+
+typedef struct
+{
+    thermal_supervisor_config_t config;
+    thermal_fault_t fault;
+
+    bool has_previous;
+    float previous_temperature;
+    float lowest_temperature;
+    float stuck_elapsed;
+
+    float window_elapsed;
+    float window_start_temperature;
+    float window_expected_rise;
+    float saturated_peak;
+} thermal_supervisor_t;
+
+void thermal_supervisor_init(thermal_supervisor_t *supervisor, const thermal_supervisor_config_t *config);
+bool thermal_supervisor_set_model(thermal_supervisor_t *supervisor, const fopdt_model_t *model);
+thermal_fault_t thermal_supervisor_update(thermal_supervisor_t *supervisor, float temperature, float sample_age, float power, bool armed, float dt);
+thermal_fault_t thermal_supervisor_get_fault(const thermal_supervisor_t *supervisor);
+void thermal_supervisor_clear_fault(thermal_supervisor_t *supervisor);
+void thermal_supervisor_latch_fault(thermal_supervisor_t *supervisor, thermal_fault_t fault);
+const char *thermal_supervisor_fault_name(thermal_fault_t fault);
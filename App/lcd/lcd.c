@@ -74,6 +74,8 @@ typedef struct
 
 static lcd_handler_t lcd_handler;
 
+static StaticSemaphore_t lcd_buffer_mutex_control_block;
+
 static void handle_error(void);
 static bool lcd_send_command(uint8_t cmd);
 static bool lcd_send_data(uint8_t data);
@@ -173,7 +175,13 @@ bool lcd_init(void)
     osDelay(110);
     lcd_send(CMD(ST7735S_DISPON));
 
-    lcd_handler.buffer_mutex = osMutexNew(NULL);
+    const osMutexAttr_t mutex_attributes =
+    {
+        .cb_mem = &lcd_buffer_mutex_control_block,
+        .cb_size = sizeof(lcd_buffer_mutex_control_block)
+    };
+
+    lcd_handler.buffer_mutex = osMutexNew(&mutex_attributes);
 
     return (lcd_handler.buffer_mutex != NULL);
 }
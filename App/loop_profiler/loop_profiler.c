@@ -0,0 +1,211 @@
+/**
+ * Control loop timing
+ *
+ * Records loop period, its deviation from the nominal period and the
+ * duration of each loop phase as min/max/mean, plus a histogram of period
+ * jitter.
+ *
+ * Phases run with the core awake and are timed with the Cortex-M4 DWT
+ * cycle counter. The counter stops while the core sleeps between loops, so
+ * the period is taken from the 1 us run-time counter instead, which keeps
+ * counting through Sleep and Stop 2. The cycle counter wraps after 53 s at
+ * 80 MHz and the run-time counter after 71 minutes, both well above the
+ * longest control period. Host builds replace both counters with stubs
+ * that tests advance by hand.
+ */
+
+#include "loop_profiler.h"
+
+#include <stddef.h>
+
+#ifdef __arm__
+#include "main.h"
+#include "cmsis_os.h"
+#include "runtime_stats.h"
+
+#define PROFILE_LOCK() taskENTER_CRITICAL()
+#define PROFILE_UNLOCK() taskEXIT_CRITICAL()
+#else
+#define PROFILE_LOCK()
+#define PROFILE_UNLOCK()
+
+static uint32_t stub_cycles;
+static uint32_t stub_time_us;
+static uint32_t stub_clock_hz = 80000000;
+#endif
+
+static uint32_t read_cycles(void);
+static uint32_t read_time_us(void);
+static uint32_t read_time_us(void)
+{
+#ifdef __arm__
+    return runtime_stats_get_counter();
+#else
+    return stub_time_us;
+#endif
+}
+
+static uint32_t cycles_to_us(uint32_t cycles);
+static void record(loop_statistic_t *statistic, uint32_t value_us);
+
+bool loop_profiler_init(loop_profiler_t *profiler, uint32_t nominal_period_us, uint32_t histogram_bin_us)
+{
+#ifdef __arm__
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    if ((DWT->CTRL & DWT_CTRL_NOCYCCNT_Msk) != 0)
+    {
+        return false;
+    }
+#endif
+
+    profiler->profile.histogram_bin_us = (histogram_bin_us > 0) ? histogram_bin_us : LOOP_PROFILER_DEFAULT_BIN_US;
+    profiler->profile.nominal_period_us = nominal_period_us;
+    loop_profiler_reset(profiler);
+
+    return true;
+}
+
+void loop_profiler_reset(loop_profiler_t *profiler)
+{
+    loop_profile_t *profile = &profiler->profile;
+    loop_statistic_t empty = { .count = 0, .min_us = UINT32_MAX, .max_us = 0, .sum_us = 0 };
+
+    PROFILE_LOCK();
+    profile->period = empty;
+    profile->jitter = empty;
+
+    for (uint8_t i = 0; i < LOOP_PHASE_NUMBER; i++)
+    {
+        profile->phase[i] = empty;
+    }
+
+    for (uint8_t i = 0; i < LOOP_PROFILER_HISTOGRAM_BINS; i++)
+    {
+        profile->jitter_histogram[i] = 0;
+    }
+
+    profiler->started = false;
+    PROFILE_UNLOCK();
+}
+
+void loop_profiler_set_nominal_period(loop_profiler_t *profiler, uint32_t nominal_period_us)
+{
+    profiler->profile.nominal_period_us = nominal_period_us;
+}
+
+void loop_profiler_loop_start(loop_profiler_t *profiler)
+{
+    uint32_t now = read_time_us();
+
+    if (profiler->started)
+    {
+        uint32_t period_us = now - profiler->loop_start_us;
+        uint32_t nominal_us = profiler->profile.nominal_period_us;
+        uint32_t jitter_us = (period_us > nominal_us) ? period_us - nominal_us : nominal_us - period_us;
+        uint32_t bin = jitter_us / profiler->profile.histogram_bin_us;
+
+        if (bin >= LOOP_PROFILER_HISTOGRAM_BINS)
+        {
+            bin = LOOP_PROFILER_HISTOGRAM_BINS - 1;
+        }
+
+        PROFILE_LOCK();
+        record(&profiler->profile.period, period_us);
+        record(&profiler->profile.jitter, jitter_us);
+        profiler->profile.jitter_histogram[bin]++;
+        PROFILE_UNLOCK();
+    }
+
+    profiler->loop_start_us = now;
+    profiler->started = true;
+}
+
+void loop_profiler_phase_begin(loop_profiler_t *profiler, loop_phase_t phase)
+{
+    if (phase < LOOP_PHASE_NUMBER)
+    {
+        profiler->phase_start_cycles[phase] = read_cycles();
+    }
+}
+
+void loop_profiler_phase_end(loop_profiler_t *profiler, loop_phase_t phase)
+{
+    if (phase < LOOP_PHASE_NUMBER)
+    {
+        uint32_t duration_us = cycles_to_us(read_cycles() - profiler->phase_start_cycles[phase]);
+
+        PROFILE_LOCK();
+        record(&profiler->profile.phase[phase], duration_us);
+        PROFILE_UNLOCK();
+    }
+}
+
+void loop_profiler_get_profile(const loop_profiler_t *profiler, loop_profile_t *profile)
+{
+    PROFILE_LOCK();
+    *profile = profiler->profile;
+    PROFILE_UNLOCK();
+}
+
+uint32_t loop_profiler_mean_us(const loop_statistic_t *statistic)
+{
+    return (statistic->count > 0) ? (uint32_t)(statistic->sum_us / statistic->count) : 0;
+}
+
+#ifndef __arm__
+void loop_profiler_stub_set_clock_hz(uint32_t clock_hz)
+{
+    stub_clock_hz = clock_hz;
+}
+
+void loop_profiler_stub_advance_us(uint32_t microseconds)
+{
+    stub_cycles += (uint32_t)((uint64_t)microseconds * stub_clock_hz / 1000000u);
+    stub_time_us += microseconds;
+}
+
+/* Time spent asleep: the cycle counter stands still, the run-time counter does not. */
+void loop_profiler_stub_sleep_us(uint32_t microseconds)
+{
+    stub_time_us += microseconds;
+}
+#endif
+
+static uint32_t read_cycles(void)
+{
+#ifdef __arm__
+    return DWT->CYCCNT;
+#else
+    return stub_cycles;
+#endif
+}
+
+static uint32_t cycles_to_us(uint32_t cycles)
+{
+#ifdef __arm__
+    uint32_t clock_hz = SystemCoreClock;
+#else
+    uint32_t clock_hz = stub_clock_hz;
+#endif
+
+    return (uint32_t)((uint64_t)cycles * 1000000u / clock_hz);
+}
+
+static void record(loop_statistic_t *statistic, uint32_t value_us)
+{
+    statistic->count++;
+    statistic->sum_us += value_us;
+
+    if (value_us < statistic->min_us)
+    {
+        statistic->min_us = value_us;
+    }
+
+    if (value_us > statistic->max_us)
+    {
+        statistic->max_us = value_us;
+    }
+}
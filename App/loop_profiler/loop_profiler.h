@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LOOP_PROFILER_HISTOGRAM_BINS 16
+#define LOOP_PROFILER_DEFAULT_BIN_US 50
+
+typedef enum
+{
+    LOOP_PHASE_SENSOR_READ,
+    LOOP_PHASE_COMPUTE,
+    LOOP_PHASE_ACTUATION,
+
+    LOOP_PHASE_NUMBER,
+} loop_phase_t;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+} loop_statistic_t;
+
+typedef struct
+{
+    loop_statistic_t period;
+    loop_statistic_t jitter;
+    loop_statistic_t phase[LOOP_PHASE_NUMBER];
+    uint32_t jitter_histogram[LOOP_PROFILER_HISTOGRAM_BINS];
+    uint32_t histogram_bin_us;
+    uint32_t nominal_period_us;
+} loop_profile_t;
+
+typedef struct
+{
+    loop_profile_t profile;
+    uint32_t loop_start_us;
+    uint32_t phase_start_cycles[LOOP_PHASE_NUMBER];
+    bool started;
+} loop_profiler_t;
+
+bool loop_profiler_init(loop_profiler_t *profiler, uint32_t nominal_period_us, uint32_t histogram_bin_us);
+void loop_profiler_reset(loop_profiler_t *profiler);
+void loop_profiler_set_nominal_period(loop_profiler_t *profiler, uint32_t nominal_period_us);
+void loop_profiler_loop_start(loop_profiler_t *profiler);
+void loop_profiler_phase_begin(loop_profiler_t *profiler, loop_phase_t phase);
+void loop_profiler_phase_end(loop_profiler_t *profiler, loop_phase_t phase);
+void loop_profiler_get_profile(const loop_profiler_t *profiler, loop_profile_t *profile);
+uint32_t loop_profiler_mean_us(const loop_statistic_t *statistic);
+
+#ifndef __arm__
+void loop_profiler_stub_set_clock_hz(uint32_t clock_hz);
+void loop_profiler_stub_advance_us(uint32_t microseconds);
+void loop_profiler_stub_sleep_us(uint32_t microseconds);
+#endif
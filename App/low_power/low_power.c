@@ -0,0 +1,382 @@
+/**
+ * Tickless idle with LPTIM1 wake-up and Stop 2 entry
+ *
+ * When every task is blocked the kernel passes the expected idle time to
+ * vPortSuppressTicksAndSleep. SysTick and the TIM1 HAL time base are
+ * stopped and LPTIM1, clocked by the LSI, wakes the core when the next task
+ * is due. Idle periods are spent in Stop 2 when they are long enough and
+ * nothing needs the high-speed clocks:
+ *  - SPI1 has no DMA transfer to the LCD in progress,
+ *  - I2C1 has no transfer in progress,
+ *  - no module holds a stop inhibit; the heater outputs hold one while a
+ *    duty is set, as TIM3 would freeze the pins in their current state.
+ * Otherwise the core only enters Sleep mode.
+ *
+ * On wake-up the time slept is read back from LPTIM1 and added to both the
+ * kernel and the HAL tick, using the LSI frequency estimated by the RTC
+ * calibration, or the nominal LSI_VALUE until it has measured one. Fractions
+ * of a tick are carried over to the next idle period.
+ */
+
+#include "low_power.h"
+#include "main.h"
+#include "spi.h"
+#include "i2c.h"
+#include "rtc.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "rtc_calibration.h"
+
+#define LPTIM_PRESCALER      32u
+#define LPTIM_PRESCALER_BITS (LPTIM_CFGR_PRESC_2 | LPTIM_CFGR_PRESC_0)
+#define LPTIM_MAX_COUNT      0xFFFFu
+#define LPTIM_IRQ_PRIORITY   15
+#define LPTIM_SYNC_TIMEOUT_MS 10
+
+/* One tick is lsi_hz units, one LPTIM count is UNITS_PER_COUNT units. */
+#define UNITS_PER_COUNT      (LPTIM_PRESCALER * configTICK_RATE_HZ)
+
+#define MIN_SLEEP_COUNTS     2u
+#define MAX_IDLE_TICKS       60000u
+#define STOP2_MIN_IDLE_TICKS 20u
+#define WAKEUP_WINDOW_MS     10000u
+
+typedef struct
+{
+    volatile uint32_t inhibit_mask;
+    uint32_t tick_remainder;
+    volatile uint32_t stop_time_us;
+
+    low_power_stats_t stats;
+    uint32_t window_start_ms;
+    uint32_t window_wakeups;
+
+    bool initialized;
+} low_power_handler_t;
+
+static low_power_handler_t low_power_handler;
+
+extern TIM_HandleTypeDef htim1;
+
+static bool lptim_init(void);
+static uint16_t lptim_read_counter(void);
+static void lptim_set_compare(uint32_t compare);
+static uint32_t lsi_frequency(void);
+static bool stop_allowed(TickType_t idle_ticks);
+static void restore_system_clock(void);
+static void resync_rtc_shadow(void);
+static void restart_systick(void);
+static void record_wakeup(bool stop, TickType_t ticks);
+
+bool low_power_init(void)
+{
+#ifdef DEBUG
+    /* Keeps the debug port alive in Stop 2. */
+    HAL_DBGMCU_EnableDBGStopMode();
+#endif
+
+    low_power_handler.window_start_ms = HAL_GetTick();
+    low_power_handler.initialized = lptim_init();
+
+    return low_power_handler.initialized;
+}
+
+void low_power_inhibit_stop(low_power_inhibit_t source, bool inhibit)
+{
+    if (source >= LOW_POWER_INHIBIT_NUMBER)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    if (inhibit)
+    {
+        low_power_handler.inhibit_mask |= (1u << source);
+    }
+    else
+    {
+        low_power_handler.inhibit_mask &= ~(1u << source);
+    }
+    taskEXIT_CRITICAL();
+}
+
+bool low_power_get_stats(low_power_stats_t *stats)
+{
+    if (stats == NULL)
+    {
+        return false;
+    }
+
+    taskENTER_CRITICAL();
+    *stats = low_power_handler.stats;
+    taskEXIT_CRITICAL();
+
+    return true;
+}
+
+/* Total time spent in Stop 2, wrapping like a 32-bit microsecond timer. */
+uint32_t low_power_get_stop_time_us(void)
+{
+    return low_power_handler.stop_time_us;
+}
+
+/* The compare match only has to wake the core. */
+void low_power_lptim_irq_handler(void)
+{
+    LPTIM1->ICR = LPTIM_ICR_CMPMCF;
+}
+
+/* Called by the idle task with the scheduler suspended. */
+void vPortSuppressTicksAndSleep(TickType_t xExpectedIdleTime)
+{
+    if (!low_power_handler.initialized)
+    {
+        return;
+    }
+
+    if (xExpectedIdleTime > MAX_IDLE_TICKS)
+    {
+        xExpectedIdleTime = MAX_IDLE_TICKS;
+    }
+
+    uint32_t lsi_hz = lsi_frequency();
+
+    /* PRIMASK rather than a critical section, so that interrupts still end the sleep. */
+    __disable_irq();
+    __DSB();
+    __ISB();
+
+    if (eTaskConfirmSleepModeStatus() == eAbortSleep)
+    {
+        low_power_handler.stats.abort_count++;
+        __enable_irq();
+        return;
+    }
+
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+
+    if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)
+    {
+        SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+        low_power_handler.stats.abort_count++;
+        __enable_irq();
+        return;
+    }
+
+    /* Time already owed to the kernel: the carried fraction and the part of the current tick. */
+    uint32_t reload = SysTick->LOAD + 1;
+    uint64_t elapsed_units = low_power_handler.tick_remainder + (uint64_t)(reload - SysTick->VAL) * lsi_hz / reload;
+
+    /* The last tick is left to SysTick, so the kernel never steps past the unblock time. */
+    uint64_t target_units = (uint64_t)(xExpectedIdleTime - 1) * lsi_hz;
+    uint32_t counts = (target_units > elapsed_units) ? (uint32_t)((target_units - elapsed_units) / UNITS_PER_COUNT) : 0;
+
+    if (counts < MIN_SLEEP_COUNTS)
+    {
+        SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+        low_power_handler.stats.abort_count++;
+        __enable_irq();
+        return;
+    }
+
+    uint16_t start = lptim_read_counter();
+    lptim_set_compare(start + counts);
+
+    bool stop = stop_allowed(xExpectedIdleTime);
+
+    HAL_SuspendTick();
+
+    if (stop)
+    {
+        HAL_PWREx_EnterSTOP2Mode(PWR_STOPENTRY_WFI);
+        restore_system_clock();
+        resync_rtc_shadow();
+    }
+    else
+    {
+        __DSB();
+        __WFI();
+        __ISB();
+    }
+
+    uint16_t elapsed_counts = (uint16_t)(lptim_read_counter() - start);
+    elapsed_units += (uint64_t)elapsed_counts * UNITS_PER_COUNT;
+
+    if (stop)
+    {
+        low_power_handler.stop_time_us += (uint32_t)((uint64_t)elapsed_counts * LPTIM_PRESCALER * 1000000u / lsi_hz);
+    }
+
+    TickType_t ticks = (TickType_t)(elapsed_units / lsi_hz);
+    if (ticks > xExpectedIdleTime - 1)
+    {
+        ticks = xExpectedIdleTime - 1;
+    }
+
+    elapsed_units -= (uint64_t)ticks * lsi_hz;
+    low_power_handler.tick_remainder = (elapsed_units < lsi_hz) ? (uint32_t)elapsed_units : lsi_hz - 1;
+
+    if (ticks > 0)
+    {
+        uwTick += ticks * 1000u / configTICK_RATE_HZ;
+        vTaskStepTick(ticks);
+    }
+
+    /* TIM1 may have overflowed while its interrupt was off; that tick is already counted. */
+    __HAL_TIM_CLEAR_FLAG(&htim1, TIM_FLAG_UPDATE);
+    HAL_ResumeTick();
+    restart_systick();
+
+    record_wakeup(stop, ticks);
+
+    __enable_irq();
+}
+
+static bool lptim_init(void)
+{
+    __HAL_RCC_LPTIM1_CONFIG(RCC_LPTIM1CLKSOURCE_LSI);
+    __HAL_RCC_LPTIM1_CLK_ENABLE();
+    __HAL_RCC_LPTIM1_FORCE_RESET();
+    __HAL_RCC_LPTIM1_RELEASE_RESET();
+
+    /* CFGR and IER can only be written while the timer is disabled, ARR and CMP only while it is enabled. */
+    LPTIM1->CFGR = LPTIM_PRESCALER_BITS;
+    LPTIM1->IER = LPTIM_IER_CMPMIE;
+    LPTIM1->CR = LPTIM_CR_ENABLE;
+    LPTIM1->ARR = LPTIM_MAX_COUNT;
+
+    uint32_t tickstart = HAL_GetTick();
+    while ((LPTIM1->ISR & LPTIM_ISR_ARROK) == 0)
+    {
+        if (HAL_GetTick() - tickstart > LPTIM_SYNC_TIMEOUT_MS)
+        {
+            return false;
+        }
+    }
+
+    LPTIM1->ICR = LPTIM_ICR_ARROKCF;
+    LPTIM1->CR |= LPTIM_CR_CNTSTRT;
+
+    /* EXTI line 32 carries the LPTIM1 wake-up out of Stop 2. */
+    EXTI->IMR2 |= EXTI_IMR2_IM32;
+
+    HAL_NVIC_SetPriority(LPTIM1_IRQn, LPTIM_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(LPTIM1_IRQn);
+
+    return true;
+}
+
+/* The counter runs from the asynchronous LSI, a read is only valid when two in a row agree. */
+static uint16_t lptim_read_counter(void)
+{
+    uint32_t first;
+    uint32_t second = LPTIM1->CNT;
+
+    do
+    {
+        first = second;
+        second = LPTIM1->CNT;
+    } while (first != second);
+
+    return (uint16_t)second;
+}
+
+static void lptim_set_compare(uint32_t compare)
+{
+    /* CMP must stay below ARR, so a match on the last count moves to the next one. */
+    compare &= LPTIM_MAX_COUNT;
+    if (compare == LPTIM_MAX_COUNT)
+    {
+        compare = 0;
+    }
+
+    LPTIM1->ICR = LPTIM_ICR_CMPOKCF | LPTIM_ICR_CMPMCF;
+    NVIC_ClearPendingIRQ(LPTIM1_IRQn);
+
+    /* The write has to reach the LSI domain before the bus clock stops. */
+    LPTIM1->CMP = compare;
+    while ((LPTIM1->ISR & LPTIM_ISR_CMPOK) == 0)
+    {
+    }
+}
+
+static uint32_t lsi_frequency(void)
+{
+    rtc_calibration_status_t status;
+
+    /* clock_hz is derived from the configured prescalers until a window has been measured. */
+    if (rtc_calibration_get_status(&status) && status.measurement_count > 0 && status.clock_hz > 0.0f)
+    {
+        return (uint32_t)(status.clock_hz + 0.5f);
+    }
+
+    return LSI_VALUE;
+}
+
+static bool stop_allowed(TickType_t idle_ticks)
+{
+    return idle_ticks >= STOP2_MIN_IDLE_TICKS && low_power_handler.inhibit_mask == 0 &&
+           HAL_SPI_GetState(&hspi1) == HAL_SPI_STATE_READY && HAL_I2C_GetState(&hi2c1) == HAL_I2C_STATE_READY;
+}
+
+/* Stop 2 exits on the MSI; the PLL keeps its configuration and only has to be restarted. */
+static void restore_system_clock(void)
+{
+    __HAL_RCC_PLL_ENABLE();
+    while (__HAL_RCC_GET_FLAG(RCC_FLAG_PLLRDY) == 0)
+    {
+    }
+
+    __HAL_RCC_SYSCLK_CONFIG(RCC_SYSCLKSOURCE_PLLCLK);
+    while (__HAL_RCC_GET_SYSCLK_SOURCE() != RCC_SYSCLKSOURCE_STATUS_PLLCLK)
+    {
+    }
+}
+
+/*
+ * The calendar shadow registers are not updated in Stop 2, so RSF is cleared
+ * and the next copy awaited before the pending RTC interrupts read the time.
+ * The copy comes within two RTCCLK periods; the HAL timeout cannot expire
+ * with the tick stopped but is never needed.
+ */
+static void resync_rtc_shadow(void)
+{
+    __HAL_RTC_WRITEPROTECTION_DISABLE(&hrtc);
+    HAL_RTC_WaitForSynchro(&hrtc);
+    __HAL_RTC_WRITEPROTECTION_ENABLE(&hrtc);
+}
+
+/* Starts a full tick period; the part already elapsed is kept in tick_remainder. */
+static void restart_systick(void)
+{
+    SysTick->VAL = 0;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+}
+
+static void record_wakeup(bool stop, TickType_t ticks)
+{
+    low_power_stats_t *stats = &low_power_handler.stats;
+    uint32_t slept_ms = ticks * 1000u / configTICK_RATE_HZ;
+
+    if (stop)
+    {
+        stats->stop_count++;
+        stats->stop_ms += slept_ms;
+    }
+    else
+    {
+        stats->sleep_count++;
+        stats->sleep_ms += slept_ms;
+    }
+
+    low_power_handler.window_wakeups++;
+
+    uint32_t now = HAL_GetTick();
+    uint32_t window = now - low_power_handler.window_start_ms;
+    if (window >= WAKEUP_WINDOW_MS)
+    {
+        stats->wakeups_per_second = low_power_handler.window_wakeups * 1000.0f / window;
+        low_power_handler.window_wakeups = 0;
+        low_power_handler.window_start_ms = now;
+    }
+}
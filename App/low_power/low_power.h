@@ -0,0 +1,28 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum
+{
+    LOW_POWER_INHIBIT_HEATER,
+
+    LOW_POWER_INHIBIT_NUMBER,
+} low_power_inhibit_t;
+
+typedef struct
+{
+    uint32_t sleep_count;
+    uint32_t stop_count;
+    uint32_t abort_count;
+
+    uint64_t sleep_ms;
+    uint64_t stop_ms;
+
+    float wakeups_per_second; /* exits from Sleep or Stop 2 over the last measurement window */
+} low_power_stats_t;
+
+bool low_power_init(void);
+void low_power_inhibit_stop(low_power_inhibit_t source, bool inhibit);
+bool low_power_get_stats(low_power_stats_t *stats);
+uint32_t low_power_get_stop_time_us(void);
+void low_power_lptim_irq_handler(void);
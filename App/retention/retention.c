@@ -0,0 +1,112 @@
+/**
+ * Warm-restart retention
+ *
+ * Blocks in SRAM2 survive system, watchdog and brown-out resets as long as
+ * VDD stays above the retention level, but hold random data after a
+ * power-on. Each block carries a magic, its size and a CRC-32, so a block is
+ * only trusted when it was sealed by the same layout.
+ */
+
+#include "retention.h"
+#include "main.h"
+
+typedef struct
+{
+    retention_reset_cause_t reset_cause;
+} retention_handler_t;
+
+static retention_handler_t retention_handler;
+
+static const uint32_t crc_table[16] =
+{
+    0x00000000u, 0x1DB71064u, 0x3B6E20C8u, 0x26D930ACu, 0x76DC4190u, 0x6B6B51F4u, 0x4DB26158u, 0x5005713Cu,
+    0xEDB88320u, 0xF00F9344u, 0xD6D6A3E8u, 0xCB61B38Cu, 0x9B64C2B0u, 0x86D3D2D4u, 0xA00AE278u, 0xBDBDF21Cu,
+};
+
+static const char *reset_cause_names[RETENTION_RESET_NUMBER] =
+{
+    [RETENTION_RESET_POWER_ON] = "power-on",
+    [RETENTION_RESET_PIN] = "pin",
+    [RETENTION_RESET_SOFTWARE] = "software",
+    [RETENTION_RESET_WATCHDOG] = "watchdog",
+    [RETENTION_RESET_LOW_POWER] = "low-power",
+    [RETENTION_RESET_OTHER] = "other",
+};
+
+static uint32_t crc32(const void *data, uint32_t size);
+
+/* Latches and clears the reset flags; BOR is also set on every power-on. */
+bool retention_init(void)
+{
+    if (__HAL_RCC_GET_FLAG(RCC_FLAG_BORRST))
+    {
+        retention_handler.reset_cause = RETENTION_RESET_POWER_ON;
+    }
+    else if (__HAL_RCC_GET_FLAG(RCC_FLAG_IWDGRST) || __HAL_RCC_GET_FLAG(RCC_FLAG_WWDGRST))
+    {
+        retention_handler.reset_cause = RETENTION_RESET_WATCHDOG;
+    }
+    else if (__HAL_RCC_GET_FLAG(RCC_FLAG_SFTRST))
+    {
+        retention_handler.reset_cause = RETENTION_RESET_SOFTWARE;
+    }
+    else if (__HAL_RCC_GET_FLAG(RCC_FLAG_LPWRRST))
+    {
+        retention_handler.reset_cause = RETENTION_RESET_LOW_POWER;
+    }
+    else if (__HAL_RCC_GET_FLAG(RCC_FLAG_PINRST))
+    {
+        retention_handler.reset_cause = RETENTION_RESET_PIN;
+    }
+    else
+    {
+        retention_handler.reset_cause = RETENTION_RESET_OTHER;
+    }
+
+    __HAL_RCC_CLEAR_RESET_FLAGS();
+
+    return true;
+}
+
+retention_reset_cause_t retention_get_reset_cause(void)
+{
+    return retention_handler.reset_cause;
+}
+
+const char *retention_reset_cause_name(retention_reset_cause_t cause)
+{
+    return (cause < RETENTION_RESET_NUMBER) ? reset_cause_names[cause] : "unknown";
+}
+
+bool retention_is_valid(const retention_header_t *header, uint32_t magic, const void *data, uint32_t size)
+{
+    return header->magic == magic && header->size == size && header->crc == crc32(data, size);
+}
+
+void retention_seal(retention_header_t *header, uint32_t magic, const void *data, uint32_t size)
+{
+    header->magic = magic;
+    header->size = size;
+    header->crc = crc32(data, size);
+}
+
+void retention_invalidate(retention_header_t *header)
+{
+    header->magic = 0;
+}
+
+/* Reflected CRC-32 (IEEE 802.3), four bits per table lookup. */
+static uint32_t crc32(const void *data, uint32_t size)
+{
+    const uint8_t *bytes = data;
+    uint32_t crc = 0xFFFFFFFFu;
+
+    for (uint32_t i = 0; i < size; i++)
+    {
+        crc ^= bytes[i];
+        crc = (crc >> 4) ^ crc_table[crc & 0x0Fu];
+        crc = (crc >> 4) ^ crc_table[crc & 0x0Fu];
+    }
+
+    return ~crc;
+}
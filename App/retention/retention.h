@@ -0,0 +1,33 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Places a variable in the .retained section of SRAM2, which the startup code leaves untouched. */
+#define RETAINED __attribute__((section(".retained")))
+
+typedef enum
+{
+    RETENTION_RESET_POWER_ON,
+    RETENTION_RESET_PIN,
+    RETENTION_RESET_SOFTWARE,
+    RETENTION_RESET_WATCHDOG,
+    RETENTION_RESET_LOW_POWER,
+    RETENTION_RESET_OTHER,
+
+    RETENTION_RESET_NUMBER,
+} retention_reset_cause_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t size;
+    uint32_t crc;
+} retention_header_t;
+
+bool retention_init(void);
+retention_reset_cause_t retention_get_reset_cause(void);
+const char *retention_reset_cause_name(retention_reset_cause_t cause);
+
+bool retention_is_valid(const retention_header_t *header, uint32_t magic, const void *data, uint32_t size);
+void retention_seal(retention_header_t *header, uint32_t magic, const void *data, uint32_t size);
+void retention_invalidate(retention_header_t *header);
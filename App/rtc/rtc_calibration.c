@@ -0,0 +1,426 @@
+/**
+ * RTC drift measurement and calibration
+ *
+ * The RTC runs from the LSI, which is off by up to a few percent. The rate
+ * of the RTC is measured against a reference, either TIM2 (1 MHz from the
+ * MSI-PLL system clock) over fixed windows or time stamps sent by a host,
+ * and corrected in two steps: the prescalers bring the 1 Hz clock within
+ * the +-488 ppm range of the smooth calibration, which then trims the rest
+ * in about 1 ppm steps. Once a host reference has been seen the TIM2
+ * windows are ignored, as the MSI itself is only accurate to about 1%.
+ *
+ * TIM2 stops in Stop 2, so timer windows that contain a Stop 2 period are
+ * dropped; in practice the TIM2 reference is only used while the heaters
+ * keep the core out of Stop 2.
+ *
+ * Prescaler and calibration registers sit in the backup domain and keep
+ * their values across resets. Changing the prescalers passes through the
+ * RTC init mode, which restarts the current second.
+ */
+
+#include "rtc_calibration.h"
+#include "cmsis_os.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "tim.h"
+#include "low_power.h"
+#include "stack_monitor.h"
+
+#include <math.h>
+
+#define CALIBRATION_TASK_STACK_SIZE (256 * 4)
+#define CALIBRATION_TASK_PRIORITY   osPriorityBelowNormal
+
+#define CALIBRATION_FLAG_HOST     0x01u
+#define CALIBRATION_FLAG_TIME_SET 0x02u
+
+#define TIMER_WINDOW_MS       (1024u * 1000u)
+#define TIMER_SMOOTHING       0.25f
+#define HOST_MIN_INTERVAL_US  (600ull * RTC_TIMESTAMP_US_PER_SECOND)
+#define APPLY_THRESHOLD_PPM   2.0f
+
+#define SMOOTH_CYCLE          1048576.0 /* RTCCLK cycles per 32 s calibration window */
+#define SMOOTH_MAX_PLUS       512
+#define SMOOTH_MAX_MINUS      511
+#define MIN_ASYNCH_DIVISION   4         /* CALP must stay clear below this */
+#define MAX_ASYNCH_DIVISION   128
+#define MAX_SYNCH_DIVISION    32768
+#define NOMINAL_DIVISION      (128.0 * 256.0)
+
+typedef struct
+{
+    uint32_t asynch_division;
+    uint32_t synch_division;
+    bool plus_pulses;
+    uint32_t minus_pulses;
+} rtc_dividers_t;
+
+typedef struct
+{
+    rtc_calibration_status_t status;
+    rtc_dividers_t dividers;
+    bool host_seen;
+
+    uint32_t window_start_tick;
+    rtc_timestamp_t window_rtc;
+    uint32_t window_timer;
+    uint32_t window_stop_count;
+
+    bool host_valid;
+    rtc_timestamp_t host_rtc;
+    rtc_timestamp_t host_reference;
+    bool host_pending;
+    float host_pending_ppm;
+
+    osThreadId_t task_handle;
+} rtc_calibration_handler_t;
+
+static rtc_calibration_handler_t calibration_handler;
+
+static StaticTask_t calibration_task_control_block;
+static StackType_t calibration_task_stack[CALIBRATION_TASK_STACK_SIZE / sizeof(StackType_t)];
+
+static void rtc_calibration_task(void *argument);
+static void start_window(void);
+static void finish_window(void);
+static void record_measurement(rtc_calibration_source_t source, float ppm);
+static void adjust(float error_ppm);
+static bool compute_dividers(double clock_hz, rtc_dividers_t *dividers);
+static bool apply_dividers(const rtc_dividers_t *dividers);
+static double effective_division(const rtc_dividers_t *dividers);
+static void update_status_dividers(void);
+
+bool rtc_calibration_init(void)
+{
+    bool task_ok = false;
+    uint32_t prescaler = hrtc.Instance->PRER;
+    uint32_t calibration = hrtc.Instance->CALR;
+
+    /* HAL_RTC_Init leaves an initialised calendar alone, so adopt what a previous calibration left behind. */
+    calibration_handler.dividers.asynch_division = ((prescaler & RTC_PRER_PREDIV_A_Msk) >> RTC_PRER_PREDIV_A_Pos) + 1;
+    calibration_handler.dividers.synch_division = (prescaler & RTC_PRER_PREDIV_S_Msk) + 1;
+    calibration_handler.dividers.plus_pulses = (calibration & RTC_CALR_CALP) != 0;
+    calibration_handler.dividers.minus_pulses = calibration & RTC_CALR_CALM;
+    hrtc.Init.AsynchPrediv = calibration_handler.dividers.asynch_division - 1;
+    hrtc.Init.SynchPrediv = calibration_handler.dividers.synch_division - 1;
+
+    calibration_handler.status.source = RTC_CALIBRATION_SOURCE_NONE;
+    update_status_dividers();
+
+    const osThreadAttr_t task_attributes =
+    {
+        .name = "RtcCalTask",
+        .priority = CALIBRATION_TASK_PRIORITY,
+        .cb_mem = &calibration_task_control_block,
+        .cb_size = sizeof(calibration_task_control_block),
+        .stack_mem = calibration_task_stack,
+        .stack_size = sizeof(calibration_task_stack)
+    };
+
+    calibration_handler.task_handle = osThreadNew(rtc_calibration_task, NULL, &task_attributes);
+    task_ok = (calibration_handler.task_handle != NULL) &&
+              stack_monitor_register(calibration_handler.task_handle, sizeof(calibration_task_stack)) &&
+              rtc_subscribe(RTC_EVENT_TIME_SET, calibration_handler.task_handle, CALIBRATION_FLAG_TIME_SET);
+
+    return task_ok;
+}
+
+/* reference is the true time of this call. Returns true when it closed a measurement interval; the RTC must not be set in between. */
+bool rtc_calibration_host_sync(rtc_timestamp_t reference)
+{
+    rtc_timestamp_t now = rtc_get_timestamp();
+    rtc_timestamp_t rtc_elapsed = 0;
+    rtc_timestamp_t reference_elapsed = 0;
+
+    taskENTER_CRITICAL();
+    if (calibration_handler.host_valid && reference > calibration_handler.host_reference)
+    {
+        rtc_elapsed = now - calibration_handler.host_rtc;
+        reference_elapsed = reference - calibration_handler.host_reference;
+    }
+
+    if (!calibration_handler.host_valid || reference <= calibration_handler.host_reference || reference_elapsed >= HOST_MIN_INTERVAL_US)
+    {
+        calibration_handler.host_rtc = now;
+        calibration_handler.host_reference = reference;
+        calibration_handler.host_valid = true;
+    }
+    taskEXIT_CRITICAL();
+
+    if (reference_elapsed < HOST_MIN_INTERVAL_US)
+    {
+        return false;
+    }
+
+    float ppm = (float)(((double)rtc_elapsed / (double)reference_elapsed - 1.0) * 1e6);
+
+    taskENTER_CRITICAL();
+    calibration_handler.host_pending_ppm = ppm;
+    calibration_handler.host_pending = true;
+    taskEXIT_CRITICAL();
+
+    osThreadFlagsSet(calibration_handler.task_handle, CALIBRATION_FLAG_HOST);
+
+    return true;
+}
+
+bool rtc_calibration_get_status(rtc_calibration_status_t *status)
+{
+    if (status == NULL)
+    {
+        return false;
+    }
+
+    taskENTER_CRITICAL();
+    *status = calibration_handler.status;
+    taskEXIT_CRITICAL();
+
+    return true;
+}
+
+static void rtc_calibration_task(void *argument)
+{
+    (void)argument;
+
+    start_window();
+
+    for (;;)
+    {
+        uint32_t elapsed = osKernelGetTickCount() - calibration_handler.window_start_tick;
+        uint32_t window_ticks = TIMER_WINDOW_MS * osKernelGetTickFreq() / 1000u;
+        uint32_t timeout = (elapsed < window_ticks) ? window_ticks - elapsed : 0;
+        uint32_t flags = osThreadFlagsWait(CALIBRATION_FLAG_HOST | CALIBRATION_FLAG_TIME_SET, osFlagsWaitAny, timeout);
+
+        if (flags == (uint32_t)osFlagsErrorTimeout || flags == (uint32_t)osFlagsErrorResource)
+        {
+            finish_window();
+            continue;
+        }
+
+        if (flags & osFlagsError)
+        {
+            continue;
+        }
+
+        if (flags & CALIBRATION_FLAG_TIME_SET)
+        {
+            taskENTER_CRITICAL();
+            calibration_handler.host_valid = false;
+            calibration_handler.host_pending = false;
+            taskEXIT_CRITICAL();
+
+            start_window();
+        }
+
+        if (flags & CALIBRATION_FLAG_HOST)
+        {
+            taskENTER_CRITICAL();
+            bool pending = calibration_handler.host_pending;
+            float ppm = calibration_handler.host_pending_ppm;
+            calibration_handler.host_pending = false;
+            taskEXIT_CRITICAL();
+
+            if (pending)
+            {
+                calibration_handler.host_seen = true;
+                record_measurement(RTC_CALIBRATION_SOURCE_HOST, ppm);
+            }
+        }
+    }
+}
+
+/* The RTC and TIM2 are read back to back so both ends of the window refer to the same instant. */
+static void start_window(void)
+{
+    low_power_stats_t power;
+
+    low_power_get_stats(&power);
+    calibration_handler.window_stop_count = power.stop_count;
+
+    taskENTER_CRITICAL();
+    calibration_handler.window_rtc = rtc_get_timestamp();
+    calibration_handler.window_timer = __HAL_TIM_GET_COUNTER(&htim2);
+    taskEXIT_CRITICAL();
+
+    calibration_handler.window_start_tick = osKernelGetTickCount();
+}
+
+/* TIM2 wraps after 4295 s, so a window must stay shorter than that. */
+static void finish_window(void)
+{
+    low_power_stats_t power;
+
+    low_power_get_stats(&power);
+    bool stopped = power.stop_count != calibration_handler.window_stop_count;
+
+    taskENTER_CRITICAL();
+    rtc_timestamp_t rtc_now = rtc_get_timestamp();
+    uint32_t timer_now = __HAL_TIM_GET_COUNTER(&htim2);
+    taskEXIT_CRITICAL();
+
+    /* A time set in between moves the RTC backwards or forwards; only forward windows are measured. */
+    bool rtc_advanced = rtc_now > calibration_handler.window_rtc;
+    rtc_timestamp_t rtc_elapsed = rtc_now - calibration_handler.window_rtc;
+    uint32_t timer_elapsed = timer_now - calibration_handler.window_timer;
+
+    start_window();
+
+    if (!stopped && timer_elapsed > 0 && rtc_advanced)
+    {
+        record_measurement(RTC_CALIBRATION_SOURCE_TIMER, (float)(((double)rtc_elapsed / (double)timer_elapsed - 1.0) * 1e6));
+    }
+}
+
+static void record_measurement(rtc_calibration_source_t source, float ppm)
+{
+    if (source == RTC_CALIBRATION_SOURCE_TIMER && calibration_handler.host_seen)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    rtc_calibration_status_t *status = &calibration_handler.status;
+    bool first = (status->measurement_count == 0) || (status->source != source);
+
+    status->source = source;
+    status->measured_ppm = ppm;
+    status->measurement_count++;
+
+    /* A host interval is long enough to be taken as is, TIM2 windows are averaged. */
+    if (first || source == RTC_CALIBRATION_SOURCE_HOST)
+    {
+        status->drift_ppm = ppm;
+    }
+    else
+    {
+        status->drift_ppm += TIMER_SMOOTHING * (ppm - status->drift_ppm);
+    }
+
+    float drift = status->drift_ppm;
+    taskEXIT_CRITICAL();
+
+    if (fabsf(drift) >= APPLY_THRESHOLD_PPM)
+    {
+        adjust(drift);
+    }
+}
+
+/* A fast RTC divides a faster clock than assumed, so the divider is scaled up by the error. */
+static void adjust(float error_ppm)
+{
+    rtc_dividers_t dividers;
+    double clock_hz = effective_division(&calibration_handler.dividers) * (1.0 + error_ppm * 1e-6);
+
+    if (!compute_dividers(clock_hz, &dividers) || !apply_dividers(&dividers))
+    {
+        return;
+    }
+
+    calibration_handler.dividers = dividers;
+
+    taskENTER_CRITICAL();
+    calibration_handler.status.drift_ppm = 0.0f;
+    calibration_handler.status.adjustment_count++;
+    calibration_handler.host_valid = false;
+    taskEXIT_CRITICAL();
+
+    update_status_dividers();
+    start_window();
+}
+
+/* Picks the largest asynchronous division, which draws the least current, that leaves a residual smooth calibration can take. */
+static bool compute_dividers(double clock_hz, rtc_dividers_t *dividers)
+{
+    for (uint32_t asynch = MAX_ASYNCH_DIVISION; asynch >= MIN_ASYNCH_DIVISION; asynch--)
+    {
+        uint32_t synch = (uint32_t)lround(clock_hz / asynch);
+
+        if (synch < 1 || synch > MAX_SYNCH_DIVISION)
+        {
+            continue;
+        }
+
+        /* Smooth calibration scales the clock by 2^20 / (2^20 - pulses), with pulses = 512 * CALP - CALM. */
+        long pulses = lround(SMOOTH_CYCLE * (1.0 - clock_hz / ((double)asynch * synch)));
+
+        if (pulses < -SMOOTH_MAX_MINUS || pulses > SMOOTH_MAX_PLUS)
+        {
+            continue;
+        }
+
+        dividers->asynch_division = asynch;
+        dividers->synch_division = synch;
+        dividers->plus_pulses = (pulses > 0);
+        dividers->minus_pulses = (uint32_t)(dividers->plus_pulses ? SMOOTH_MAX_PLUS - pulses : -pulses);
+
+        return true;
+    }
+
+    return false;
+}
+
+/* PRER and CALR are written under the RTC lock, like every other RTC register write. */
+static bool apply_dividers(const rtc_dividers_t *dividers)
+{
+    bool prescaler_ok = true;
+
+    if (!rtc_lock())
+    {
+        return false;
+    }
+
+    if (dividers->asynch_division != calibration_handler.dividers.asynch_division ||
+        dividers->synch_division != calibration_handler.dividers.synch_division)
+    {
+        __HAL_RTC_WRITEPROTECTION_DISABLE(&hrtc);
+        prescaler_ok = (RTC_EnterInitMode(&hrtc) == HAL_OK);
+
+        if (prescaler_ok)
+        {
+            /* PRER takes two separate writes, synchronous part first. */
+            hrtc.Instance->PRER = dividers->synch_division - 1;
+            hrtc.Instance->PRER |= (dividers->asynch_division - 1) << RTC_PRER_PREDIV_A_Pos;
+            prescaler_ok = (RTC_ExitInitMode(&hrtc) == HAL_OK);
+        }
+
+        __HAL_RTC_WRITEPROTECTION_ENABLE(&hrtc);
+
+        if (prescaler_ok)
+        {
+            hrtc.Init.AsynchPrediv = dividers->asynch_division - 1;
+            hrtc.Init.SynchPrediv = dividers->synch_division - 1;
+        }
+    }
+
+    bool calibration_ok = prescaler_ok &&
+                          HAL_RTCEx_SetSmoothCalib(&hrtc, RTC_SMOOTHCALIB_PERIOD_32SEC,
+                                                   dividers->plus_pulses ? RTC_SMOOTHCALIB_PLUSPULSES_SET : RTC_SMOOTHCALIB_PLUSPULSES_RESET,
+                                                   dividers->minus_pulses) == HAL_OK;
+    rtc_unlock();
+
+    return calibration_ok;
+}
+
+/* RTCCLK cycles per calendar second. */
+static double effective_division(const rtc_dividers_t *dividers)
+{
+    double pulses = (dividers->plus_pulses ? SMOOTH_MAX_PLUS : 0) - (double)dividers->minus_pulses;
+
+    return (double)dividers->asynch_division * dividers->synch_division * (SMOOTH_CYCLE - pulses) / SMOOTH_CYCLE;
+}
+
+static void update_status_dividers(void)
+{
+    const rtc_dividers_t *dividers = &calibration_handler.dividers;
+    double division = effective_division(dividers);
+
+    taskENTER_CRITICAL();
+    rtc_calibration_status_t *status = &calibration_handler.status;
+    status->asynch_prediv = (uint8_t)(dividers->asynch_division - 1);
+    status->synch_prediv = (uint16_t)(dividers->synch_division - 1);
+    status->plus_pulses = dividers->plus_pulses;
+    status->minus_pulses = (uint16_t)dividers->minus_pulses;
+    status->correction_ppm = (float)((NOMINAL_DIVISION / division - 1.0) * 1e6);
+    status->clock_hz = (float)(division * (1.0 + status->drift_ppm * 1e-6));
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "rtc_module.h"
+
+typedef enum
+{
+    RTC_CALIBRATION_SOURCE_NONE,
+    RTC_CALIBRATION_SOURCE_TIMER,
+    RTC_CALIBRATION_SOURCE_HOST,
+
+    RTC_CALIBRATION_SOURCE_NUMBER,
+} rtc_calibration_source_t;
+
+typedef struct
+{
+    rtc_calibration_source_t source;
+    uint32_t measurement_count;
+    uint32_t adjustment_count;
+
+    float measured_ppm;   /* rate error of the last window, positive when the RTC runs fast */
+    float drift_ppm;      /* smoothed error still left after the applied correction */
+    float correction_ppm; /* applied by prescalers and smooth calibration, relative to the CubeMX setup */
+    float clock_hz;       /* estimated RTC kernel clock (LSI) */
+
+    uint8_t asynch_prediv;
+    uint16_t synch_prediv;
+    bool plus_pulses;
+    uint16_t minus_pulses;
+} rtc_calibration_status_t;
+
+bool rtc_calibration_init(void);
+bool rtc_calibration_host_sync(rtc_timestamp_t reference);
+bool rtc_calibration_get_status(rtc_calibration_status_t *status);
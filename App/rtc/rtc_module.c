@@ -1,43 +1,109 @@
-#include "rtc_module.h"
+/**
+ * RTC module
+ *
+ * The RTC wake-up timer runs from the 1 Hz calendar clock, so its interrupt
+ * fires right after every second boundary. The interrupt refreshes the
+ * cached time and date and publishes them as the data bus time tick; no
+ * task polls the RTC.
+ *
+ * Timestamps combine the calendar with the sub-second register into one
+ * 64-bit microsecond count and can be read from tasks and interrupts. The
+ * RTC runs from the LSI and jumps when the time is set, so intervals are
+ * better measured with the monotonic time derived from the RTOS tick.
+ *
+ * The calendar survives resets: it is only set to the default at boot when
+ * the backup-register marker written with every set is missing. Alarms A
+ * and B match weekday, hour and minute and set the owner's thread flags.
+ *
+ * Every task that writes RTC registers holds the RTC lock, so a write never
+ * finds the HAL handle locked and fails with HAL_BUSY. The interrupts only
+ * read the calendar and do not take it.
+ */
 
 #include "rtc_module.h"
-#include "cmsis_os.h"
+#include "data_bus.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define BACKUP_VALID_REGISTER RTC_BKP_DR0
+#define BACKUP_VALID_MAGIC 0x32F2u
+
+typedef struct
+{
+    osThreadId_t thread;
+    uint32_t flags;
+} rtc_subscriber_t;
 
 typedef struct
 {
     RTC_TimeTypeDef current_time;
     RTC_DateTypeDef current_date;
+    rtc_subscriber_t subscribers[RTC_EVENT_NUMBER][RTC_MAX_SUBSCRIBERS];
+    uint8_t subscriber_count[RTC_EVENT_NUMBER];
+    rtc_subscriber_t alarm_owners[RTC_ALARM_SLOT_NUMBER];
+
+    uint32_t cached_date_register;
+    uint32_t cached_days;
+    TickType_t last_tick;
+    uint32_t tick_overflows;
+
     osMutexId_t mutex;
 } rtc_handler_t;
 
 static rtc_handler_t rtc_handler;
-static osThreadId_t rtc_task_handle;
 
-static void rtc_task(void *argument);
+static StaticSemaphore_t rtc_mutex_control_block;
+
+static const uint32_t alarm_ids[RTC_ALARM_SLOT_NUMBER] =
+{
+    [RTC_ALARM_SLOT_A] = RTC_ALARM_A,
+    [RTC_ALARM_SLOT_B] = RTC_ALARM_B,
+};
+
+static void refresh_cache(void);
+static void time_set(void);
+static void publish_time_tick(void);
+static void notify(rtc_event_t event);
+static void notify_alarm(rtc_alarm_slot_t slot);
+static uint32_t days_since_2000(uint32_t date_register);
 static bool rtc_reset_time_and_date(void);
-static void handle_error(void);
 
 bool rtc_init(void)
 {
-    bool mutex_initialized = false;
-    bool task_initialized = false;
-    bool rtc_initialized = false;
+    const osMutexAttr_t mutex_attributes =
+    {
+        .cb_mem = &rtc_mutex_control_block,
+        .cb_size = sizeof(rtc_mutex_control_block)
+    };
 
-    rtc_handler.mutex = osMutexNew(NULL);
-    mutex_initialized = (rtc_handler.mutex != NULL);
+    rtc_handler.mutex = osMutexNew(&mutex_attributes);
+    if (!rtc_lock())
+    {
+        return false;
+    }
 
-    const osThreadAttr_t rtc_task_attributes = {
-        .name = "RTCTask",
-        .priority = osPriorityLow,
-        .stack_size = 128 * 4
-    };
+    bool rtc_initialized = true;
+
+    if (HAL_RTCEx_BKUPRead(&hrtc, BACKUP_VALID_REGISTER) != BACKUP_VALID_MAGIC)
+    {
+        rtc_initialized = rtc_reset_time_and_date();
+    }
+
+    for (rtc_alarm_slot_t slot = 0; slot < RTC_ALARM_SLOT_NUMBER; slot++)
+    {
+        HAL_RTC_DeactivateAlarm(&hrtc, alarm_ids[slot]);
+    }
+
+    rtc_unlock();
 
-    rtc_task_handle = osThreadNew(rtc_task, NULL, &rtc_task_attributes);
-    task_initialized = (rtc_task_handle != NULL);
+    taskENTER_CRITICAL();
+    refresh_cache();
+    taskEXIT_CRITICAL();
 
-    rtc_initialized = rtc_reset_time_and_date();
+    publish_time_tick();
 
-    return mutex_initialized && task_initialized && rtc_initialized;
+    return rtc_initialized;
 }
 
 bool rtc_set_time(uint8_t hours, uint8_t minutes, uint8_t seconds)
@@ -47,7 +113,17 @@ bool rtc_set_time(uint8_t hours, uint8_t minutes, uint8_t seconds)
     new_time.Minutes = minutes;
     new_time.Seconds = seconds;
 
-    return HAL_RTC_SetTime(&hrtc, &new_time, RTC_FORMAT_BIN) == HAL_OK;
+    if (!rtc_lock())
+    {
+        return false;
+    }
+
+    bool time_ok = HAL_RTC_SetTime(&hrtc, &new_time, RTC_FORMAT_BIN) == HAL_OK;
+    rtc_unlock();
+
+    time_set();
+
+    return time_ok;
 }
 
 bool rtc_set_date(uint8_t weekday, uint8_t day, uint8_t month, uint8_t year)
@@ -58,80 +134,276 @@ bool rtc_set_date(uint8_t weekday, uint8_t day, uint8_t month, uint8_t year)
     new_date.Month = month;
     new_date.Year = year;
 
-    return HAL_RTC_SetDate(&hrtc, &new_date, RTC_FORMAT_BIN) == HAL_OK;
+    if (!rtc_lock())
+    {
+        return false;
+    }
+
+    bool date_ok = HAL_RTC_SetDate(&hrtc, &new_date, RTC_FORMAT_BIN) == HAL_OK;
+    rtc_unlock();
+
+    time_set();
+
+    return date_ok;
 }
 
 RTC_TimeTypeDef rtc_get_time_struct(void)
 {
-    RTC_TimeTypeDef time_copy = {0};
+    taskENTER_CRITICAL();
+    RTC_TimeTypeDef time_copy = rtc_handler.current_time;
+    taskEXIT_CRITICAL();
 
-    if (osMutexAcquire(rtc_handler.mutex, osWaitForever) == osOK)
+    return time_copy;
+}
+
+RTC_DateTypeDef rtc_get_date_struct(void)
+{
+    taskENTER_CRITICAL();
+    RTC_DateTypeDef date_copy = rtc_handler.current_date;
+    taskEXIT_CRITICAL();
+
+    return date_copy;
+}
+
+/* Reading the sub-second register freezes the time and date shadow registers until the date is read. */
+rtc_timestamp_t rtc_get_timestamp(void)
+{
+    UBaseType_t interrupt_state = taskENTER_CRITICAL_FROM_ISR();
+    uint32_t sub_seconds = hrtc.Instance->SSR;
+    uint32_t time_register = hrtc.Instance->TR & RTC_TR_RESERVED_MASK;
+    uint32_t date_register = hrtc.Instance->DR & RTC_DR_RESERVED_MASK;
+
+    if (date_register != rtc_handler.cached_date_register)
     {
-        time_copy = rtc_handler.current_time;
+        rtc_handler.cached_days = days_since_2000(date_register);
+        rtc_handler.cached_date_register = date_register;
+    }
 
-        if (osMutexRelease(rtc_handler.mutex) != osOK)
-        {
-            handle_error();
-        }
+    uint32_t days = rtc_handler.cached_days;
+    taskEXIT_CRITICAL_FROM_ISR(interrupt_state);
+
+    uint32_t hours = RTC_Bcd2ToByte((time_register & (RTC_TR_HT | RTC_TR_HU)) >> RTC_TR_HU_Pos);
+    uint32_t minutes = RTC_Bcd2ToByte((time_register & (RTC_TR_MNT | RTC_TR_MNU)) >> RTC_TR_MNU_Pos);
+    uint32_t seconds = RTC_Bcd2ToByte((time_register & (RTC_TR_ST | RTC_TR_SU)) >> RTC_TR_SU_Pos);
+    uint32_t prescaler = hrtc.Init.SynchPrediv;
+
+    if (sub_seconds > prescaler)
+    {
+        sub_seconds = prescaler;
     }
-    else
+
+    uint64_t total_seconds = (uint64_t)days * 86400u + hours * 3600u + minutes * 60u + seconds;
+    uint64_t fraction_us = (uint64_t)(prescaler - sub_seconds) * RTC_TIMESTAMP_US_PER_SECOND / (prescaler + 1);
+
+    return total_seconds * RTC_TIMESTAMP_US_PER_SECOND + fraction_us;
+}
+
+/* The 32-bit tick count is extended here; the wake-up interrupt calls this every second so no wrap is missed. */
+uint64_t rtc_get_monotonic_us(void)
+{
+    UBaseType_t interrupt_state = taskENTER_CRITICAL_FROM_ISR();
+    TickType_t tick = xTaskGetTickCountFromISR();
+
+    if (tick < rtc_handler.last_tick)
     {
-        handle_error();
+        rtc_handler.tick_overflows++;
     }
 
-    return time_copy;
+    rtc_handler.last_tick = tick;
+    uint64_t ticks = ((uint64_t)rtc_handler.tick_overflows << 32) | tick;
+    taskEXIT_CRITICAL_FROM_ISR(interrupt_state);
+
+    return ticks * RTC_TIMESTAMP_US_PER_SECOND / configTICK_RATE_HZ;
 }
 
-RTC_DateTypeDef rtc_get_date_struct(void)
+/* TIME_SET subscribers are flagged after the time or date was set; the seconds are on the data bus. */
+bool rtc_subscribe(rtc_event_t event, osThreadId_t thread, uint32_t flags)
 {
-    RTC_DateTypeDef date_copy = {0};
+    bool subscribed = false;
 
-    if (osMutexAcquire(rtc_handler.mutex, osWaitForever) == osOK)
+    if (event >= RTC_EVENT_NUMBER || thread == NULL || flags == 0)
     {
-        date_copy = rtc_handler.current_date;
+        return false;
+    }
 
-        if (osMutexRelease(rtc_handler.mutex) != osOK)
-        {
-            handle_error();
-        }
+    taskENTER_CRITICAL();
+    uint8_t count = rtc_handler.subscriber_count[event];
+    if (count < RTC_MAX_SUBSCRIBERS)
+    {
+        rtc_handler.subscribers[event][count].thread = thread;
+        rtc_handler.subscribers[event][count].flags = flags;
+        rtc_handler.subscriber_count[event] = count + 1;
+        subscribed = true;
     }
-    else
+    taskEXIT_CRITICAL();
+
+    return subscribed;
+}
+
+/* Fires once at the next weekday/hours/minutes:00 and sets flags on thread. */
+bool rtc_set_alarm(rtc_alarm_slot_t slot, uint8_t weekday, uint8_t hours, uint8_t minutes, osThreadId_t thread, uint32_t flags)
+{
+    if (slot >= RTC_ALARM_SLOT_NUMBER || weekday < RTC_WEEKDAY_MONDAY || weekday > RTC_WEEKDAY_SUNDAY || hours > 23 || minutes > 59)
     {
-        handle_error();
+        return false;
     }
 
-    return date_copy;
+    RTC_AlarmTypeDef alarm = {0};
+    alarm.AlarmTime.Hours = hours;
+    alarm.AlarmTime.Minutes = minutes;
+    alarm.AlarmTime.Seconds = 0;
+    alarm.AlarmMask = RTC_ALARMMASK_NONE;
+    alarm.AlarmSubSecondMask = RTC_ALARMSUBSECONDMASK_ALL;
+    alarm.AlarmDateWeekDaySel = RTC_ALARMDATEWEEKDAYSEL_WEEKDAY;
+    alarm.AlarmDateWeekDay = weekday;
+    alarm.Alarm = alarm_ids[slot];
+
+    taskENTER_CRITICAL();
+    rtc_handler.alarm_owners[slot].thread = thread;
+    rtc_handler.alarm_owners[slot].flags = flags;
+    taskEXIT_CRITICAL();
+
+    if (!rtc_lock())
+    {
+        return false;
+    }
+
+    bool alarm_ok = HAL_RTC_SetAlarm_IT(&hrtc, &alarm, RTC_FORMAT_BIN) == HAL_OK;
+    rtc_unlock();
+
+    return alarm_ok;
+}
+
+bool rtc_cancel_alarm(rtc_alarm_slot_t slot)
+{
+    if (slot >= RTC_ALARM_SLOT_NUMBER || !rtc_lock())
+    {
+        return false;
+    }
+
+    bool cancel_ok = HAL_RTC_DeactivateAlarm(&hrtc, alarm_ids[slot]) == HAL_OK;
+    rtc_unlock();
+
+    return cancel_ok;
+}
+
+/* Held around every RTC register write from a task; not usable from interrupts. */
+bool rtc_lock(void)
+{
+    return rtc_handler.mutex != NULL && osMutexAcquire(rtc_handler.mutex, osWaitForever) == osOK;
+}
+
+void rtc_unlock(void)
+{
+    osMutexRelease(rtc_handler.mutex);
 }
 
-static void rtc_task(void *argument)
+void HAL_RTCEx_WakeUpTimerEventCallback(RTC_HandleTypeDef *hrtc)
 {
-    (void)argument;
+    (void)hrtc;
+
+    rtc_get_monotonic_us();
+
+    UBaseType_t interrupt_state = taskENTER_CRITICAL_FROM_ISR();
+    refresh_cache();
+    taskEXIT_CRITICAL_FROM_ISR(interrupt_state);
+
+    publish_time_tick();
+}
+
+void HAL_RTC_AlarmAEventCallback(RTC_HandleTypeDef *hrtc)
+{
+    (void)hrtc;
+    notify_alarm(RTC_ALARM_SLOT_A);
+}
+
+void HAL_RTCEx_AlarmBEventCallback(RTC_HandleTypeDef *hrtc)
+{
+    (void)hrtc;
+    notify_alarm(RTC_ALARM_SLOT_B);
+}
+
+/* Reading the time locks the shadow registers until the date is read, so both are always read together. */
+static void refresh_cache(void)
+{
+    HAL_RTC_GetTime(&hrtc, &rtc_handler.current_time, RTC_FORMAT_BIN);
+    HAL_RTC_GetDate(&hrtc, &rtc_handler.current_date, RTC_FORMAT_BIN);
+}
+
+/* Marks the calendar as valid so the next boot keeps it, then tells the TIME_SET subscribers. */
+static void time_set(void)
+{
+    HAL_RTCEx_BKUPWrite(&hrtc, BACKUP_VALID_REGISTER, BACKUP_VALID_MAGIC);
+
+    taskENTER_CRITICAL();
+    refresh_cache();
+    taskEXIT_CRITICAL();
 
-    for (;;)
+    publish_time_tick();
+    notify(RTC_EVENT_TIME_SET);
+}
+
+/* Called from the wake-up interrupt and from tasks. */
+static void publish_time_tick(void)
+{
+    rtc_time_tick_t tick;
+
+    tick.timestamp = rtc_get_timestamp();
+
+    UBaseType_t interrupt_state = taskENTER_CRITICAL_FROM_ISR();
+    tick.time = rtc_handler.current_time;
+    tick.date = rtc_handler.current_date;
+    taskEXIT_CRITICAL_FROM_ISR(interrupt_state);
+
+    data_bus_publish(DATA_BUS_TOPIC_TIME_TICK, &tick, sizeof(tick));
+}
+
+/* Subscribers are only ever appended, so the count read first covers initialised entries. */
+static void notify(rtc_event_t event)
+{
+    uint8_t count = rtc_handler.subscriber_count[event];
+
+    for (uint8_t i = 0; i < count; i++)
     {
-        RTC_TimeTypeDef time_buffer;
-        RTC_DateTypeDef date_buffer;
+        osThreadFlagsSet(rtc_handler.subscribers[event][i].thread, rtc_handler.subscribers[event][i].flags);
+    }
+}
 
-        HAL_RTC_GetTime(&hrtc, &time_buffer, RTC_FORMAT_BIN);
-        HAL_RTC_GetDate(&hrtc, &date_buffer, RTC_FORMAT_BIN);
+/* The alarm can be serviced before the wake-up interrupt of the same second, so the cache is refreshed first. */
+static void notify_alarm(rtc_alarm_slot_t slot)
+{
+    UBaseType_t interrupt_state = taskENTER_CRITICAL_FROM_ISR();
+    refresh_cache();
+    taskEXIT_CRITICAL_FROM_ISR(interrupt_state);
 
-        if (osMutexAcquire(rtc_handler.mutex, osWaitForever) == osOK)
-        {
-            rtc_handler.current_time = time_buffer;
-            rtc_handler.current_date = date_buffer;
+    if (rtc_handler.alarm_owners[slot].thread != NULL)
+    {
+        osThreadFlagsSet(rtc_handler.alarm_owners[slot].thread, rtc_handler.alarm_owners[slot].flags);
+    }
+}
 
-            if (osMutexRelease(rtc_handler.mutex) != osOK)
-            {
-                handle_error();
-            }
-        }
-        else
-        {
-            handle_error();
-        }
+/* RTC years 00-99 are 2000-2099, where every fourth year is a leap year. */
+static uint32_t days_since_2000(uint32_t date_register)
+{
+    static const uint16_t days_before_month[12] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+
+    uint32_t year = RTC_Bcd2ToByte((date_register & (RTC_DR_YT | RTC_DR_YU)) >> RTC_DR_YU_Pos);
+    uint32_t month = RTC_Bcd2ToByte((date_register & (RTC_DR_MT | RTC_DR_MU)) >> RTC_DR_MU_Pos);
+    uint32_t day = RTC_Bcd2ToByte((date_register & (RTC_DR_DT | RTC_DR_DU)) >> RTC_DR_DU_Pos);
+
+    if (month < 1 || month > 12 || day < 1)
+    {
+        return 0;
+    }
+
+    uint32_t days = year * 365u + (year + 3u) / 4u + days_before_month[month - 1] + day - 1;
 
-        osDelay(1000);
+    if (month > 2 && (year % 4u) == 0)
+    {
+        days++;
     }
+
+    return days;
 }
 
 static bool rtc_reset_time_and_date(void)
@@ -151,10 +423,10 @@ static bool rtc_reset_time_and_date(void)
     bool time_ok = HAL_RTC_SetTime(&hrtc, &default_time, RTC_FORMAT_BIN) == HAL_OK;
     bool date_ok = HAL_RTC_SetDate(&hrtc, &default_date, RTC_FORMAT_BIN) == HAL_OK;
 
-    return time_ok && date_ok;
-}
-
-static void handle_error(void)
-{
+    if (time_ok && date_ok)
+    {
+        HAL_RTCEx_BKUPWrite(&hrtc, BACKUP_VALID_REGISTER, BACKUP_VALID_MAGIC);
+    }
 
+    return time_ok && date_ok;
 }
@@ -3,6 +3,36 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "rtc.h"
+#include "cmsis_os.h"
+
+#define RTC_MAX_SUBSCRIBERS 4
+#define RTC_TIMESTAMP_US_PER_SECOND 1000000ULL
+
+/* Microseconds since 2000-01-01 00:00:00 RTC time. */
+typedef uint64_t rtc_timestamp_t;
+
+/* Data bus TIME_TICK payload, published every second and when the time is set. */
+typedef struct
+{
+    rtc_timestamp_t timestamp;
+    RTC_TimeTypeDef time;
+    RTC_DateTypeDef date;
+} rtc_time_tick_t;
+
+typedef enum
+{
+    RTC_EVENT_TIME_SET,
+
+    RTC_EVENT_NUMBER,
+} rtc_event_t;
+
+typedef enum
+{
+    RTC_ALARM_SLOT_A,
+    RTC_ALARM_SLOT_B,
+
+    RTC_ALARM_SLOT_NUMBER,
+} rtc_alarm_slot_t;
 
 bool rtc_init(void);
 
@@ -11,3 +41,14 @@ bool rtc_set_date(uint8_t weekday, uint8_t day, uint8_t month, uint8_t year);
 
 RTC_TimeTypeDef rtc_get_time_struct(void);
 RTC_DateTypeDef rtc_get_date_struct(void);
+
+rtc_timestamp_t rtc_get_timestamp(void);
+uint64_t rtc_get_monotonic_us(void);
+
+bool rtc_subscribe(rtc_event_t event, osThreadId_t thread, uint32_t flags);
+
+bool rtc_set_alarm(rtc_alarm_slot_t slot, uint8_t weekday, uint8_t hours, uint8_t minutes, osThreadId_t thread, uint32_t flags);
+bool rtc_cancel_alarm(rtc_alarm_slot_t slot);
+
+bool rtc_lock(void);
+void rtc_unlock(void);
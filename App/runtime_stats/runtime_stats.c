@@ -0,0 +1,301 @@
+/**
+ * Per-task CPU usage from the FreeRTOS run-time statistics
+ *
+ * The kernel charges the run-time counter to the task switched out at every
+ * context switch. The counter is TIM2, free running at 1 us, with the time
+ * spent in Stop 2 added back as TIM2 stops there; that time belongs to the
+ * idle task. It wraps after 71 minutes, so loads are only ever computed from
+ * differences.
+ *
+ * A sampler task reads the counters of all tasks once per sample period and
+ * keeps a short history per task, giving the load of the last period and of
+ * a sliding window of RUNTIME_STATS_WINDOW_SAMPLES periods.
+ */
+
+#include "runtime_stats.h"
+#include "cmsis_os.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "tim.h"
+#include "low_power.h"
+#include "stack_monitor.h"
+
+#include <string.h>
+
+#define RUNTIME_STATS_TASK_STACK_SIZE (256 * 4)
+#define RUNTIME_STATS_TASK_PRIORITY   osPriorityLow
+
+#define HISTORY_LENGTH (RUNTIME_STATS_WINDOW_SAMPLES + 1)
+
+/* Only tasks.c defines the default name. */
+#ifndef configIDLE_TASK_NAME
+#define configIDLE_TASK_NAME "IDLE"
+#endif
+
+typedef struct
+{
+    bool used;
+    bool seen;
+    uint8_t samples;
+    uint32_t history[HISTORY_LENGTH];
+    runtime_stats_task_t stats;
+} runtime_stats_slot_t;
+
+typedef struct
+{
+    runtime_stats_slot_t slots[RUNTIME_STATS_MAX_TASKS];
+    TaskStatus_t status[RUNTIME_STATS_MAX_TASKS];
+
+    uint32_t total_history[HISTORY_LENGTH];
+    uint8_t head;
+    runtime_stats_summary_t summary;
+
+    osMutexId_t mutex;
+    osThreadId_t task_handle;
+} runtime_stats_handler_t;
+
+static runtime_stats_handler_t runtime_stats_handler;
+
+static StaticTask_t runtime_stats_task_control_block;
+static StackType_t runtime_stats_task_stack[RUNTIME_STATS_TASK_STACK_SIZE / sizeof(StackType_t)];
+static StaticSemaphore_t runtime_stats_mutex_control_block;
+
+static void runtime_stats_task(void *argument);
+static void take_sample(void);
+static runtime_stats_slot_t *find_slot(uint32_t task_number);
+static float load(uint32_t task_delta, uint32_t total_delta);
+
+bool runtime_stats_init(void)
+{
+    bool mutex_ok = false;
+    bool task_ok = false;
+
+    const osMutexAttr_t mutex_attributes =
+    {
+        .cb_mem = &runtime_stats_mutex_control_block,
+        .cb_size = sizeof(runtime_stats_mutex_control_block)
+    };
+
+    runtime_stats_handler.mutex = osMutexNew(&mutex_attributes);
+    if (runtime_stats_handler.mutex != NULL)
+    {
+        mutex_ok = true;
+
+        const osThreadAttr_t task_attributes =
+        {
+            .name = "RuntimeStatsTask",
+            .priority = RUNTIME_STATS_TASK_PRIORITY,
+            .cb_mem = &runtime_stats_task_control_block,
+            .cb_size = sizeof(runtime_stats_task_control_block),
+            .stack_mem = runtime_stats_task_stack,
+            .stack_size = sizeof(runtime_stats_task_stack)
+        };
+
+        runtime_stats_handler.task_handle = osThreadNew(runtime_stats_task, NULL, &task_attributes);
+        task_ok = (runtime_stats_handler.task_handle != NULL) &&
+                  stack_monitor_register(runtime_stats_handler.task_handle, sizeof(runtime_stats_task_stack));
+    }
+
+    return mutex_ok && task_ok;
+}
+
+uint8_t runtime_stats_get_table(runtime_stats_task_t *table, uint8_t max_entries)
+{
+    uint8_t count = 0;
+
+    if (table == NULL || osMutexAcquire(runtime_stats_handler.mutex, osWaitForever) != osOK)
+    {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < RUNTIME_STATS_MAX_TASKS && count < max_entries; i++)
+    {
+        if (runtime_stats_handler.slots[i].used)
+        {
+            table[count++] = runtime_stats_handler.slots[i].stats;
+        }
+    }
+
+    osMutexRelease(runtime_stats_handler.mutex);
+
+    return count;
+}
+
+bool runtime_stats_get_summary(runtime_stats_summary_t *summary)
+{
+    if (summary == NULL || osMutexAcquire(runtime_stats_handler.mutex, osWaitForever) != osOK)
+    {
+        return false;
+    }
+
+    *summary = runtime_stats_handler.summary;
+    osMutexRelease(runtime_stats_handler.mutex);
+
+    return true;
+}
+
+/* Called by the kernel before the scheduler starts, after MX_TIM2_Init. */
+void runtime_stats_start_counter(void)
+{
+    HAL_TIM_Base_Start(&htim2);
+}
+
+/* Called by the kernel on every context switch. */
+uint32_t runtime_stats_get_counter(void)
+{
+    return __HAL_TIM_GET_COUNTER(&htim2) + low_power_get_stop_time_us();
+}
+
+static void runtime_stats_task(void *argument)
+{
+    (void)argument;
+    uint32_t next_wake = osKernelGetTickCount();
+
+    for (;;)
+    {
+        if (osMutexAcquire(runtime_stats_handler.mutex, osWaitForever) == osOK)
+        {
+            take_sample();
+            osMutexRelease(runtime_stats_handler.mutex);
+        }
+
+        next_wake += RUNTIME_STATS_SAMPLE_MS * osKernelGetTickFreq() / 1000u;
+        osDelayUntil(next_wake);
+    }
+}
+
+static void take_sample(void)
+{
+    runtime_stats_handler_t *h = &runtime_stats_handler;
+    uint32_t total = 0;
+
+    /* Returns 0 when there are more tasks than entries. */
+    UBaseType_t count = uxTaskGetSystemState(h->status, RUNTIME_STATS_MAX_TASKS, &total);
+    if (count == 0)
+    {
+        return;
+    }
+
+    uint8_t previous = h->head;
+    uint8_t head = (previous + 1) % HISTORY_LENGTH;
+    uint8_t span = (h->summary.sample_count < RUNTIME_STATS_WINDOW_SAMPLES) ? h->summary.sample_count : RUNTIME_STATS_WINDOW_SAMPLES;
+    uint32_t total_delta = total - h->total_history[previous];
+
+    h->head = head;
+    h->total_history[head] = total;
+
+    for (uint8_t i = 0; i < RUNTIME_STATS_MAX_TASKS; i++)
+    {
+        h->slots[i].seen = false;
+    }
+
+    float idle_load = 100.0f;
+    float idle_window_load = 100.0f;
+
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        const TaskStatus_t *status = &h->status[i];
+        runtime_stats_slot_t *slot = find_slot(status->xTaskNumber);
+        if (slot == NULL)
+        {
+            continue;
+        }
+
+        uint32_t counter = status->ulRunTimeCounter;
+        runtime_stats_task_t *stats = &slot->stats;
+
+        if (!slot->used)
+        {
+            /* A new task starts its history at the current counter. */
+            for (uint8_t j = 0; j < HISTORY_LENGTH; j++)
+            {
+                slot->history[j] = counter;
+            }
+
+            slot->used = true;
+            slot->samples = 0;
+            stats->task_number = status->xTaskNumber;
+            stats->runtime_us = counter;
+        }
+        else
+        {
+            stats->runtime_us += counter - slot->history[previous];
+        }
+
+        strncpy(stats->name, status->pcTaskName, RUNTIME_STATS_NAME_LENGTH - 1);
+        stats->name[RUNTIME_STATS_NAME_LENGTH - 1] = '\0';
+        stats->priority = status->uxCurrentPriority;
+
+        uint8_t task_span = (slot->samples < span) ? slot->samples : span;
+        uint8_t oldest = (head + HISTORY_LENGTH - task_span) % HISTORY_LENGTH;
+
+        stats->load_percent = (slot->samples > 0) ? load(counter - slot->history[previous], total_delta) : 0.0f;
+        stats->window_load_percent = (task_span > 0) ? load(counter - slot->history[oldest], total - h->total_history[oldest]) : 0.0f;
+
+        slot->history[head] = counter;
+        if (slot->samples < RUNTIME_STATS_WINDOW_SAMPLES)
+        {
+            slot->samples++;
+        }
+        slot->seen = true;
+
+        if (strcmp(status->pcTaskName, configIDLE_TASK_NAME) == 0)
+        {
+            idle_load = stats->load_percent;
+            idle_window_load = stats->window_load_percent;
+        }
+    }
+
+    /* Deleted tasks give up their slot. */
+    uint8_t task_count = 0;
+    for (uint8_t i = 0; i < RUNTIME_STATS_MAX_TASKS; i++)
+    {
+        if (h->slots[i].used && !h->slots[i].seen)
+        {
+            h->slots[i].used = false;
+        }
+
+        task_count += h->slots[i].used ? 1 : 0;
+    }
+
+    h->summary.task_count = task_count;
+    if (h->summary.sample_count > 0)
+    {
+        h->summary.cpu_load_percent = 100.0f - idle_load;
+        h->summary.window_cpu_load_percent = 100.0f - idle_window_load;
+    }
+    h->summary.sample_count++;
+}
+
+/* The slot of a known task, otherwise a free one. */
+static runtime_stats_slot_t *find_slot(uint32_t task_number)
+{
+    runtime_stats_slot_t *free_slot = NULL;
+
+    for (uint8_t i = 0; i < RUNTIME_STATS_MAX_TASKS; i++)
+    {
+        runtime_stats_slot_t *slot = &runtime_stats_handler.slots[i];
+
+        if (slot->used && slot->stats.task_number == task_number)
+        {
+            return slot;
+        }
+
+        if (!slot->used && !slot->seen && free_slot == NULL)
+        {
+            free_slot = slot;
+        }
+    }
+
+    if (free_slot != NULL)
+    {
+        free_slot->seen = true;
+    }
+
+    return free_slot;
+}
+
+static float load(uint32_t task_delta, uint32_t total_delta)
+{
+    return (total_delta > 0) ? 100.0f * task_delta / total_delta : 0.0f;
+}
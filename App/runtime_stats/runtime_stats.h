@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RUNTIME_STATS_MAX_TASKS      16
+#define RUNTIME_STATS_NAME_LENGTH    16
+#define RUNTIME_STATS_SAMPLE_MS      1000
+#define RUNTIME_STATS_WINDOW_SAMPLES 10
+
+typedef struct
+{
+    char name[RUNTIME_STATS_NAME_LENGTH];
+    uint32_t task_number;
+    uint32_t priority;
+
+    uint64_t runtime_us;
+    float load_percent;        /* over the last sample period */
+    float window_load_percent; /* over the last RUNTIME_STATS_WINDOW_SAMPLES periods */
+} runtime_stats_task_t;
+
+typedef struct
+{
+    uint32_t sample_count;
+    uint8_t task_count;
+
+    float cpu_load_percent;        /* everything but the idle task, last sample period */
+    float window_cpu_load_percent;
+} runtime_stats_summary_t;
+
+bool runtime_stats_init(void);
+uint8_t runtime_stats_get_table(runtime_stats_task_t *table, uint8_t max_entries);
+bool runtime_stats_get_summary(runtime_stats_summary_t *summary);
+
+void runtime_stats_start_counter(void);
+uint32_t runtime_stats_get_counter(void);
@@ -0,0 +1,466 @@
+/**
+ * Calendar scheduler for time-of-day heating programs
+ *
+ * Entries repeat weekly on the days in their weekday mask. The task sleeps
+ * until RTC Alarm A fires for the next event; Alarm B is armed for the event
+ * after it so that an alarm is still pending if A is serviced late. Events up
+ * to CATCH_UP_MINUTES old are still run when the task wakes late, while a
+ * time or date change only re-arms the alarms without running skipped events.
+ * An event the heater does not accept, e.g. with its command queue full, is
+ * retried every SCHEDULER_RETRY_MS and counted as failed when it still is
+ * not accepted after SCHEDULER_RETRY_LIMIT attempts. Alarms the RTC could
+ * not arm are retried on the same period, and the events that fell due in
+ * the meantime are caught up as if the alarm had fired.
+ */
+
+#include "scheduler.h"
+#include "cmsis_os.h"
+#include "rtc_module.h"
+#include "stack_monitor.h"
+
+#define SCHEDULER_TASK_STACK_SIZE (256 * 4)
+#define SCHEDULER_TASK_PRIORITY   osPriorityBelowNormal
+
+#define SCHEDULER_FLAG_ALARM_A    0x01u
+#define SCHEDULER_FLAG_ALARM_B    0x02u
+#define SCHEDULER_FLAG_RESCHEDULE 0x04u
+#define SCHEDULER_FLAG_ALARM      (SCHEDULER_FLAG_ALARM_A | SCHEDULER_FLAG_ALARM_B)
+#define SCHEDULER_FLAG_ALL        (SCHEDULER_FLAG_ALARM | SCHEDULER_FLAG_RESCHEDULE)
+
+#define MINUTES_PER_DAY  (24u * 60u)
+#define MINUTES_PER_WEEK (7u * MINUTES_PER_DAY)
+#define CATCH_UP_MINUTES 5u
+#define NO_EVENT         UINT32_MAX
+
+typedef struct
+{
+    schedule_entry_t entries[SCHEDULER_MAX_ENTRIES];
+    bool used[SCHEDULER_MAX_ENTRIES];
+
+    uint32_t last_run_minute;
+    bool last_run_valid;
+    bool alarms_armed;
+
+    schedule_entry_t pending[SCHEDULER_MAX_ENTRIES];
+    uint8_t pending_attempts[SCHEDULER_MAX_ENTRIES];
+    uint8_t pending_count;
+    uint32_t failed_count;
+
+    osMutexId_t mutex;
+    osThreadId_t task_handle;
+} scheduler_handler_t;
+
+static scheduler_handler_t scheduler_handler;
+
+static StaticTask_t scheduler_task_control_block;
+static StackType_t scheduler_task_stack[SCHEDULER_TASK_STACK_SIZE / sizeof(StackType_t)];
+static StaticSemaphore_t scheduler_mutex_control_block;
+
+static void scheduler_task(void *argument);
+static uint32_t minute_of_week(void);
+static uint32_t minutes_since(const schedule_entry_t *entry, uint32_t now);
+static uint32_t minutes_until(const schedule_entry_t *entry, uint32_t now, uint32_t after);
+static uint8_t collect_due(uint32_t now, schedule_entry_t *due);
+static bool run_entry(const schedule_entry_t *entry);
+static void run_pending(void);
+static void add_pending(const schedule_entry_t *entry);
+static bool arm_alarms(uint32_t now);
+
+bool scheduler_init(void)
+{
+    bool mutex_ok = false;
+    bool task_ok = false;
+
+    const osMutexAttr_t mutex_attributes =
+    {
+        .cb_mem = &scheduler_mutex_control_block,
+        .cb_size = sizeof(scheduler_mutex_control_block)
+    };
+
+    scheduler_handler.mutex = osMutexNew(&mutex_attributes);
+    if (scheduler_handler.mutex != NULL)
+    {
+        mutex_ok = true;
+
+        const osThreadAttr_t task_attributes =
+        {
+            .name = "SchedulerTask",
+            .priority = SCHEDULER_TASK_PRIORITY,
+            .cb_mem = &scheduler_task_control_block,
+            .cb_size = sizeof(scheduler_task_control_block),
+            .stack_mem = scheduler_task_stack,
+            .stack_size = sizeof(scheduler_task_stack)
+        };
+
+        scheduler_handler.task_handle = osThreadNew(scheduler_task, NULL, &task_attributes);
+        task_ok = (scheduler_handler.task_handle != NULL) &&
+                  stack_monitor_register(scheduler_handler.task_handle, sizeof(scheduler_task_stack)) &&
+                  rtc_subscribe(RTC_EVENT_TIME_SET, scheduler_handler.task_handle, SCHEDULER_FLAG_RESCHEDULE);
+    }
+
+    return mutex_ok && task_ok;
+}
+
+bool scheduler_add_entry(const schedule_entry_t *entry, uint8_t *index)
+{
+    bool added = false;
+
+    if (entry == NULL || (entry->weekday_mask & SCHEDULER_DAILY) == 0 || entry->hours > 23 || entry->minutes > 59 ||
+        entry->zone >= HEATER_ZONE_NUMBER || entry->action >= SCHEDULE_ACTION_NUMBER)
+    {
+        return false;
+    }
+
+    if (entry->action == SCHEDULE_ACTION_PROGRAM && !setpoint_program_validate(entry->segments, entry->segment_count, HEATER_CONTROL_MAX_SETPOINT))
+    {
+        return false;
+    }
+
+    if (osMutexAcquire(scheduler_handler.mutex, osWaitForever) != osOK)
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < SCHEDULER_MAX_ENTRIES; i++)
+    {
+        if (!scheduler_handler.used[i])
+        {
+            scheduler_handler.entries[i] = *entry;
+            scheduler_handler.used[i] = true;
+            if (index != NULL)
+            {
+                *index = i;
+            }
+            added = true;
+            break;
+        }
+    }
+
+    osMutexRelease(scheduler_handler.mutex);
+
+    if (added)
+    {
+        scheduler_reschedule();
+    }
+
+    return added;
+}
+
+bool scheduler_remove_entry(uint8_t index)
+{
+    bool removed = false;
+
+    if (index >= SCHEDULER_MAX_ENTRIES || osMutexAcquire(scheduler_handler.mutex, osWaitForever) != osOK)
+    {
+        return false;
+    }
+
+    removed = scheduler_handler.used[index];
+    scheduler_handler.used[index] = false;
+
+    osMutexRelease(scheduler_handler.mutex);
+
+    if (removed)
+    {
+        scheduler_reschedule();
+    }
+
+    return removed;
+}
+
+bool scheduler_get_entry(uint8_t index, schedule_entry_t *entry)
+{
+    bool found = false;
+
+    if (index >= SCHEDULER_MAX_ENTRIES || entry == NULL || osMutexAcquire(scheduler_handler.mutex, osWaitForever) != osOK)
+    {
+        return false;
+    }
+
+    if (scheduler_handler.used[index])
+    {
+        *entry = scheduler_handler.entries[index];
+        found = true;
+    }
+
+    osMutexRelease(scheduler_handler.mutex);
+
+    return found;
+}
+
+void scheduler_clear(void)
+{
+    if (osMutexAcquire(scheduler_handler.mutex, osWaitForever) == osOK)
+    {
+        for (uint8_t i = 0; i < SCHEDULER_MAX_ENTRIES; i++)
+        {
+            scheduler_handler.used[i] = false;
+        }
+
+        osMutexRelease(scheduler_handler.mutex);
+        scheduler_reschedule();
+    }
+}
+
+void scheduler_reschedule(void)
+{
+    if (scheduler_handler.task_handle != NULL)
+    {
+        osThreadFlagsSet(scheduler_handler.task_handle, SCHEDULER_FLAG_RESCHEDULE);
+    }
+}
+
+/* Events dropped after SCHEDULER_RETRY_LIMIT attempts since boot. */
+uint32_t scheduler_get_failed_count(void)
+{
+    return scheduler_handler.failed_count;
+}
+
+static void scheduler_task(void *argument)
+{
+    (void)argument;
+    schedule_entry_t due[SCHEDULER_MAX_ENTRIES];
+
+    scheduler_handler.last_run_minute = minute_of_week();
+    scheduler_handler.last_run_valid = true;
+    scheduler_handler.alarms_armed = arm_alarms(scheduler_handler.last_run_minute);
+
+    for (;;)
+    {
+        bool retry = scheduler_handler.pending_count > 0 || !scheduler_handler.alarms_armed;
+        uint32_t flags = osThreadFlagsWait(SCHEDULER_FLAG_ALL, osFlagsWaitAny, retry ? SCHEDULER_RETRY_MS : osWaitForever);
+
+        run_pending();
+
+        if (flags & osFlagsError)
+        {
+            if (scheduler_handler.alarms_armed)
+            {
+                continue;
+            }
+
+            /* No alarm could fire, so events due since the last run are collected here. */
+            flags = SCHEDULER_FLAG_ALARM;
+        }
+
+        uint32_t now = minute_of_week();
+        uint8_t due_count = 0;
+
+        if (osMutexAcquire(scheduler_handler.mutex, osWaitForever) != osOK)
+        {
+            continue;
+        }
+
+        if (flags & SCHEDULER_FLAG_ALARM)
+        {
+            due_count = collect_due(now, due);
+        }
+
+        scheduler_handler.last_run_minute = now;
+        scheduler_handler.last_run_valid = true;
+        scheduler_handler.alarms_armed = arm_alarms(now);
+
+        osMutexRelease(scheduler_handler.mutex);
+
+        for (uint8_t i = 0; i < due_count; i++)
+        {
+            if (!run_entry(&due[i]))
+            {
+                add_pending(&due[i]);
+            }
+        }
+    }
+}
+
+/* Monday 00:00 is minute 0. */
+static uint32_t minute_of_week(void)
+{
+    RTC_TimeTypeDef time = rtc_get_time_struct();
+    RTC_DateTypeDef date = rtc_get_date_struct();
+    uint32_t weekday = (date.WeekDay >= RTC_WEEKDAY_MONDAY && date.WeekDay <= RTC_WEEKDAY_SUNDAY) ? date.WeekDay : RTC_WEEKDAY_MONDAY;
+
+    return (weekday - 1) * MINUTES_PER_DAY + time.Hours * 60u + time.Minutes;
+}
+
+/* Age of the latest occurrence of the entry at or before now. */
+static uint32_t minutes_since(const schedule_entry_t *entry, uint32_t now)
+{
+    uint32_t best = NO_EVENT;
+
+    for (uint8_t day = 0; day < 7; day++)
+    {
+        if (entry->weekday_mask & (1u << day))
+        {
+            uint32_t event = day * MINUTES_PER_DAY + entry->hours * 60u + entry->minutes;
+            uint32_t age = (now + MINUTES_PER_WEEK - event) % MINUTES_PER_WEEK;
+            if (age < best)
+            {
+                best = age;
+            }
+        }
+    }
+
+    return best;
+}
+
+/* Smallest distance from now to an occurrence of the entry that is greater than after. */
+static uint32_t minutes_until(const schedule_entry_t *entry, uint32_t now, uint32_t after)
+{
+    uint32_t best = NO_EVENT;
+
+    for (uint8_t day = 0; day < 7; day++)
+    {
+        if ((entry->weekday_mask & (1u << day)) == 0)
+        {
+            continue;
+        }
+
+        uint32_t event = day * MINUTES_PER_DAY + entry->hours * 60u + entry->minutes;
+        uint32_t distance = (event + MINUTES_PER_WEEK - now) % MINUTES_PER_WEEK;
+        if (distance == 0)
+        {
+            distance = MINUTES_PER_WEEK;
+        }
+
+        if (distance > after && distance < best)
+        {
+            best = distance;
+        }
+    }
+
+    return best;
+}
+
+/* Entries that came due after the last run, at most CATCH_UP_MINUTES ago. */
+static uint8_t collect_due(uint32_t now, schedule_entry_t *due)
+{
+    uint8_t count = 0;
+    uint32_t window = CATCH_UP_MINUTES + 1;
+
+    if (scheduler_handler.last_run_valid)
+    {
+        uint32_t since_last = (now + MINUTES_PER_WEEK - scheduler_handler.last_run_minute) % MINUTES_PER_WEEK;
+        if (since_last < window)
+        {
+            window = since_last;
+        }
+    }
+
+    for (uint8_t i = 0; i < SCHEDULER_MAX_ENTRIES; i++)
+    {
+        if (scheduler_handler.used[i] && minutes_since(&scheduler_handler.entries[i], now) < window)
+        {
+            due[count++] = scheduler_handler.entries[i];
+        }
+    }
+
+    return count;
+}
+
+static bool run_entry(const schedule_entry_t *entry)
+{
+    switch (entry->action)
+    {
+    case SCHEDULE_ACTION_SETPOINT:
+        return heater_set_setpoint(entry->zone, entry->setpoint);
+    case SCHEDULE_ACTION_PROGRAM:
+        return heater_program_start(entry->zone, entry->segments, entry->segment_count);
+    case SCHEDULE_ACTION_MODE:
+        return heater_set_mode(entry->zone, entry->mode);
+    default:
+        return true;
+    }
+}
+
+/* Retries in the order the events came due; only the scheduler task touches the pending list. */
+static void run_pending(void)
+{
+    uint8_t kept = 0;
+
+    for (uint8_t i = 0; i < scheduler_handler.pending_count; i++)
+    {
+        if (run_entry(&scheduler_handler.pending[i]))
+        {
+            continue;
+        }
+
+        if (++scheduler_handler.pending_attempts[i] >= SCHEDULER_RETRY_LIMIT)
+        {
+            scheduler_handler.failed_count++;
+            continue;
+        }
+
+        scheduler_handler.pending[kept] = scheduler_handler.pending[i];
+        scheduler_handler.pending_attempts[kept] = scheduler_handler.pending_attempts[i];
+        kept++;
+    }
+
+    scheduler_handler.pending_count = kept;
+}
+
+/* A newer event with the same zone and action replaces one still waiting. */
+static void add_pending(const schedule_entry_t *entry)
+{
+    uint8_t slot = scheduler_handler.pending_count;
+
+    for (uint8_t i = 0; i < scheduler_handler.pending_count; i++)
+    {
+        if (scheduler_handler.pending[i].zone == entry->zone && scheduler_handler.pending[i].action == entry->action)
+        {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot == SCHEDULER_MAX_ENTRIES)
+    {
+        scheduler_handler.failed_count++;
+        return;
+    }
+
+    scheduler_handler.pending[slot] = *entry;
+    scheduler_handler.pending_attempts[slot] = 1;
+
+    if (slot == scheduler_handler.pending_count)
+    {
+        scheduler_handler.pending_count++;
+    }
+}
+
+/* Alarm A for the next event, Alarm B for the one after it; false when the RTC refused one of them. */
+static bool arm_alarms(uint32_t now)
+{
+    bool armed = true;
+    uint32_t next[RTC_ALARM_SLOT_NUMBER] = {NO_EVENT, NO_EVENT};
+    uint32_t after = 0;
+
+    for (rtc_alarm_slot_t slot = 0; slot < RTC_ALARM_SLOT_NUMBER; slot++)
+    {
+        for (uint8_t i = 0; i < SCHEDULER_MAX_ENTRIES; i++)
+        {
+            if (scheduler_handler.used[i])
+            {
+                uint32_t distance = minutes_until(&scheduler_handler.entries[i], now, after);
+                if (distance < next[slot])
+                {
+                    next[slot] = distance;
+                }
+            }
+        }
+
+        if (next[slot] == NO_EVENT)
+        {
+            armed = rtc_cancel_alarm(slot) && armed;
+            continue;
+        }
+
+        uint32_t event = (now + next[slot]) % MINUTES_PER_WEEK;
+        uint32_t flag = (slot == RTC_ALARM_SLOT_A) ? SCHEDULER_FLAG_ALARM_A : SCHEDULER_FLAG_ALARM_B;
+
+        armed = rtc_set_alarm(slot, (uint8_t)(event / MINUTES_PER_DAY + 1), (uint8_t)((event % MINUTES_PER_DAY) / 60u),
+                              (uint8_t)(event % 60u), scheduler_handler.task_handle, flag) && armed;
+        after = next[slot];
+    }
+
+    return armed;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "heater.h"
+
+#define SCHEDULER_MAX_ENTRIES 16
+#define SCHEDULER_RETRY_MS    1000
+#define SCHEDULER_RETRY_LIMIT 10
+
+/* Weekday mask bits follow the RTC weekdays, Monday is bit 0. */
+#define SCHEDULER_WEEKDAY(weekday) (1u << ((weekday) - 1))
+#define SCHEDULER_DAILY 0x7Fu
+#define SCHEDULER_WORKDAYS 0x1Fu
+#define SCHEDULER_WEEKEND 0x60u
+
+typedef enum
+{
+    SCHEDULE_ACTION_SETPOINT,
+    SCHEDULE_ACTION_PROGRAM,
+    SCHEDULE_ACTION_MODE,
+
+    SCHEDULE_ACTION_NUMBER,
+} schedule_action_t;
+
+typedef struct
+{
+    uint8_t weekday_mask;
+    uint8_t hours;
+    uint8_t minutes;
+    heater_zone_t zone;
+    schedule_action_t action;
+    float setpoint;                     /* SETPOINT */
+    heater_mode_t mode;                 /* MODE */
+    const setpoint_segment_t *segments; /* PROGRAM: must stay valid while the entry exists */
+    uint8_t segment_count;              /* PROGRAM */
+} schedule_entry_t;
+
+bool scheduler_init(void);
+bool scheduler_add_entry(const schedule_entry_t *entry, uint8_t *index);
+bool scheduler_remove_entry(uint8_t index);
+bool scheduler_get_entry(uint8_t index, schedule_entry_t *entry);
+void scheduler_clear(void);
+void scheduler_reschedule(void);
+uint32_t scheduler_get_failed_count(void);
@@ -0,0 +1,273 @@
+/**
+ * Task stack monitoring and stack size recommendations
+ *
+ * Tasks are registered with the stack size they were created with. A
+ * monitor task samples the high-water mark of each of them, the least free
+ * stack space seen since the task started, and derives a recommended size
+ * from the deepest use plus a margin. The recommendations are only
+ * meaningful after a soak run long enough to exercise every code path, which
+ * the summary reports as soak_complete.
+ *
+ * The kernel checks the stack on every context switch. When a task has run
+ * past its stack the overflow hook records the task in SRAM2 and resets, as
+ * the memory next to the stack can no longer be trusted; the record is read
+ * back after the reset.
+ */
+
+#include "stack_monitor.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timers.h"
+#include "main.h"
+#include "retention.h"
+
+#include <string.h>
+
+#define STACK_MONITOR_TASK_STACK_SIZE (256 * 4)
+#define STACK_MONITOR_TASK_PRIORITY   osPriorityLow
+
+#define RECOMMENDED_MARGIN_BYTES 64u
+#define RECOMMENDED_ALIGN_BYTES  32u
+#define RETAINED_MAGIC           0x53544B31u
+
+typedef struct
+{
+    osThreadId_t thread;
+    uint32_t stack_size;
+    uint32_t min_free;
+} stack_monitor_task_t;
+
+typedef struct
+{
+    char name[STACK_MONITOR_NAME_LENGTH];
+    uint32_t count;
+} stack_monitor_overflow_record_t;
+
+typedef struct
+{
+    retention_header_t header;
+    stack_monitor_overflow_record_t record;
+} stack_monitor_retained_t;
+
+typedef struct
+{
+    stack_monitor_task_t tasks[STACK_MONITOR_MAX_TASKS];
+    uint8_t task_count;
+
+    uint32_t start_tick;
+    stack_monitor_overflow_t overflow;
+
+    osThreadId_t task_handle;
+} stack_monitor_handler_t;
+
+static stack_monitor_handler_t stack_monitor_handler;
+
+/* Survives the reset that follows an overflow. */
+static stack_monitor_retained_t stack_monitor_retained RETAINED;
+
+static StaticTask_t stack_monitor_task_control_block;
+static StackType_t stack_monitor_task_stack[STACK_MONITOR_TASK_STACK_SIZE / sizeof(StackType_t)];
+
+static void stack_monitor_task(void *argument);
+static void sample(void);
+static uint32_t recommended_size(uint32_t stack_size, uint32_t min_free);
+
+bool stack_monitor_init(void)
+{
+    stack_monitor_handler.start_tick = osKernelGetTickCount();
+
+    if (retention_is_valid(&stack_monitor_retained.header, RETAINED_MAGIC, &stack_monitor_retained.record, sizeof(stack_monitor_retained.record)))
+    {
+        stack_monitor_handler.overflow.valid = true;
+        stack_monitor_handler.overflow.count = stack_monitor_retained.record.count;
+        memcpy(stack_monitor_handler.overflow.name, stack_monitor_retained.record.name, STACK_MONITOR_NAME_LENGTH);
+        stack_monitor_handler.overflow.name[STACK_MONITOR_NAME_LENGTH - 1] = '\0';
+    }
+    else
+    {
+        stack_monitor_clear_overflow();
+    }
+
+    /* The kernel's own tasks come from the static buffers in cmsis_os2.c. */
+    bool kernel_ok = stack_monitor_register(xTaskGetIdleTaskHandle(), configMINIMAL_STACK_SIZE * sizeof(StackType_t)) &&
+                     stack_monitor_register(xTimerGetTimerDaemonTaskHandle(), configTIMER_TASK_STACK_DEPTH * sizeof(StackType_t));
+
+    const osThreadAttr_t task_attributes =
+    {
+        .name = "StackMonitorTask",
+        .priority = STACK_MONITOR_TASK_PRIORITY,
+        .cb_mem = &stack_monitor_task_control_block,
+        .cb_size = sizeof(stack_monitor_task_control_block),
+        .stack_mem = stack_monitor_task_stack,
+        .stack_size = sizeof(stack_monitor_task_stack)
+    };
+
+    stack_monitor_handler.task_handle = osThreadNew(stack_monitor_task, NULL, &task_attributes);
+    bool task_ok = (stack_monitor_handler.task_handle != NULL) &&
+                   stack_monitor_register(stack_monitor_handler.task_handle, sizeof(stack_monitor_task_stack));
+
+    return kernel_ok && task_ok;
+}
+
+bool stack_monitor_register(osThreadId_t thread, uint32_t stack_size)
+{
+    bool registered = false;
+
+    if (thread == NULL || stack_size == 0)
+    {
+        return false;
+    }
+
+    taskENTER_CRITICAL();
+    if (stack_monitor_handler.task_count < STACK_MONITOR_MAX_TASKS)
+    {
+        stack_monitor_task_t *task = &stack_monitor_handler.tasks[stack_monitor_handler.task_count++];
+
+        task->thread = thread;
+        task->stack_size = stack_size;
+        task->min_free = stack_size;
+        registered = true;
+    }
+    taskEXIT_CRITICAL();
+
+    return registered;
+}
+
+uint8_t stack_monitor_get_report(stack_monitor_entry_t *entries, uint8_t max_entries)
+{
+    uint8_t count = 0;
+
+    if (entries == NULL)
+    {
+        return 0;
+    }
+
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < stack_monitor_handler.task_count && count < max_entries; i++)
+    {
+        const stack_monitor_task_t *task = &stack_monitor_handler.tasks[i];
+        stack_monitor_entry_t *entry = &entries[count++];
+
+        strncpy(entry->name, pcTaskGetName((TaskHandle_t)task->thread), STACK_MONITOR_NAME_LENGTH - 1);
+        entry->name[STACK_MONITOR_NAME_LENGTH - 1] = '\0';
+        entry->stack_size = task->stack_size;
+        entry->min_free = task->min_free;
+        entry->recommended_size = recommended_size(task->stack_size, task->min_free);
+    }
+    taskEXIT_CRITICAL();
+
+    return count;
+}
+
+bool stack_monitor_get_summary(stack_monitor_summary_t *summary)
+{
+    if (summary == NULL)
+    {
+        return false;
+    }
+
+    uint32_t uptime_ms = (osKernelGetTickCount() - stack_monitor_handler.start_tick) * 1000u / osKernelGetTickFreq();
+
+    summary->uptime_ms = uptime_ms;
+    summary->soak_complete = uptime_ms >= STACK_MONITOR_SOAK_MS;
+    summary->total_size = 0;
+    summary->total_recommended = 0;
+
+    taskENTER_CRITICAL();
+    summary->task_count = stack_monitor_handler.task_count;
+    for (uint8_t i = 0; i < stack_monitor_handler.task_count; i++)
+    {
+        const stack_monitor_task_t *task = &stack_monitor_handler.tasks[i];
+
+        summary->total_size += task->stack_size;
+        summary->total_recommended += recommended_size(task->stack_size, task->min_free);
+    }
+    taskEXIT_CRITICAL();
+
+    return true;
+}
+
+bool stack_monitor_get_overflow(stack_monitor_overflow_t *overflow)
+{
+    if (overflow == NULL)
+    {
+        return false;
+    }
+
+    taskENTER_CRITICAL();
+    *overflow = stack_monitor_handler.overflow;
+    taskEXIT_CRITICAL();
+
+    return overflow->valid;
+}
+
+void stack_monitor_clear_overflow(void)
+{
+    taskENTER_CRITICAL();
+    memset(&stack_monitor_handler.overflow, 0, sizeof(stack_monitor_handler.overflow));
+    memset(&stack_monitor_retained.record, 0, sizeof(stack_monitor_retained.record));
+    retention_invalidate(&stack_monitor_retained.header);
+    taskEXIT_CRITICAL();
+}
+
+/* Called from the kernel's overflow hook with interrupts masked; does not return. */
+void stack_monitor_overflow(const char *task_name)
+{
+    stack_monitor_overflow_record_t *record = &stack_monitor_retained.record;
+
+    if (!retention_is_valid(&stack_monitor_retained.header, RETAINED_MAGIC, record, sizeof(*record)))
+    {
+        record->count = 0;
+    }
+
+    strncpy(record->name, (task_name != NULL) ? task_name : "?", STACK_MONITOR_NAME_LENGTH - 1);
+    record->name[STACK_MONITOR_NAME_LENGTH - 1] = '\0';
+    record->count++;
+    retention_seal(&stack_monitor_retained.header, RETAINED_MAGIC, record, sizeof(*record));
+
+    NVIC_SystemReset();
+}
+
+static void stack_monitor_task(void *argument)
+{
+    (void)argument;
+    uint32_t next_wake = osKernelGetTickCount();
+
+    for (;;)
+    {
+        sample();
+
+        next_wake += STACK_MONITOR_SAMPLE_MS * osKernelGetTickFreq() / 1000u;
+        osDelayUntil(next_wake);
+    }
+}
+
+static void sample(void)
+{
+    uint8_t count = stack_monitor_handler.task_count;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        stack_monitor_task_t *task = &stack_monitor_handler.tasks[i];
+        uint32_t free_bytes = uxTaskGetStackHighWaterMark((TaskHandle_t)task->thread) * sizeof(StackType_t);
+
+        taskENTER_CRITICAL();
+        if (free_bytes < task->min_free)
+        {
+            task->min_free = free_bytes;
+        }
+        taskEXIT_CRITICAL();
+    }
+}
+
+/* Deepest use plus a quarter, and a fixed margin for the exception frame stacked on interrupt entry. */
+static uint32_t recommended_size(uint32_t stack_size, uint32_t min_free)
+{
+    uint32_t used = (min_free < stack_size) ? stack_size - min_free : 0;
+    uint32_t size = used + used / 4 + RECOMMENDED_MARGIN_BYTES;
+    uint32_t minimum = configMINIMAL_STACK_SIZE * sizeof(StackType_t);
+
+    size = (size + RECOMMENDED_ALIGN_BYTES - 1) / RECOMMENDED_ALIGN_BYTES * RECOMMENDED_ALIGN_BYTES;
+
+    return (size > minimum) ? size : minimum;
+}
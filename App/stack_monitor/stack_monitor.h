@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "cmsis_os.h"
+
+#define STACK_MONITOR_MAX_TASKS   16
+#define STACK_MONITOR_NAME_LENGTH 16
+#define STACK_MONITOR_SAMPLE_MS   5000
+#define STACK_MONITOR_SOAK_MS     (24u * 60u * 60u * 1000u)
+
+typedef struct
+{
+    char name[STACK_MONITOR_NAME_LENGTH];
+    uint32_t stack_size;       /* bytes, as created */
+    uint32_t min_free;         /* lowest free space seen, bytes */
+    uint32_t recommended_size; /* bytes, deepest use plus margin */
+} stack_monitor_entry_t;
+
+typedef struct
+{
+    uint32_t uptime_ms;
+    bool soak_complete;
+    uint8_t task_count;
+
+    uint32_t total_size;
+    uint32_t total_recommended;
+} stack_monitor_summary_t;
+
+typedef struct
+{
+    bool valid;
+    char name[STACK_MONITOR_NAME_LENGTH]; /* task of the last overflow */
+    uint32_t count;                       /* overflows since the record was cleared */
+} stack_monitor_overflow_t;
+
+bool stack_monitor_init(void);
+bool stack_monitor_register(osThreadId_t thread, uint32_t stack_size);
+uint8_t stack_monitor_get_report(stack_monitor_entry_t *entries, uint8_t max_entries);
+bool stack_monitor_get_summary(stack_monitor_summary_t *summary);
+bool stack_monitor_get_overflow(stack_monitor_overflow_t *overflow);
+void stack_monitor_clear_overflow(void);
+void stack_monitor_overflow(const char *task_name);
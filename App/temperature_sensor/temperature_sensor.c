@@ -1,5 +1,8 @@
 /**
- * TMP117 temperature sensor module
+ * Temperature sensor module, schedules all registered sensor backends
+ *
+ * Every reading is published on the data bus; the getters read the bus
+ * cache, so consumers never wait for the sensor task.
  */
 
 #include "temperature_sensor.h"
@@ -9,290 +12,298 @@
 #include "cmsis_os.h"
 #include "main.h"
 
-#define I2C_HANDLE hi2c1
-extern I2C_HandleTypeDef I2C_HANDLE;
+#include "tmp117.h"
+#include "ds18b20.h"
+#include "stack_monitor.h"
+#include "data_bus.h"
 
-#define TMP117_I2C_ADDRESS (0x48 << 1)
+#define TEMPERATURE_TASK_STACK_SIZE (254 * 4)
 
-#define TMP117_TEMPERATURE_RESULT_REGISTER   0x00
-#define TMP117_CONFIGURATION_REGISTER        0x01
-#define TMP117_HIGH_TEMPERATURE_REGISTER     0x02
-#define TMP117_LOW_TEMPERATURE_REGISTER      0x03
-
-#define TMP117_MODE_CONTINUOUS   0x00
-#define TMP117_MODE_SHUTDOWN     0x01
-#define TMP117_MODE_ONE_SHOT     0x03
-
-#define ALERT_MODE_BIT_POSITION     4
-#define MOD_BITS_POSITION           10
+typedef enum
+{
+    CHANNEL_STATE_DISABLED,
+    CHANNEL_STATE_IDLE,
+    CHANNEL_STATE_CONVERTING,
+} channel_state_t;
 
 typedef struct
 {
-    float temperature;
-    osMutexId_t temperature_mutex;
-} temperature_handler_t;
+    const temperature_sensor_driver_t *driver;
+    channel_state_t state;
+    uint32_t conversion_start_tick;
+    uint32_t next_start_tick;
+} channel_handler_t;
 
 typedef struct
 {
-	bool alarm;
-	osMutexId_t alarm_mutex;
-} alarm_handler_t;
+    channel_handler_t channels[TEMPERATURE_SENSOR_CHANNEL_NUMBER];
+    temperature_samples_t samples;
+} temperature_handler_t;
 
 typedef struct
 {
     temperature_handler_t temperature_handler;
-    alarm_handler_t alarm_handler;
     osThreadId_t task_handle;
 } ts_handler_t;
 
+static const temperature_sensor_driver_t *const channel_drivers[TEMPERATURE_SENSOR_CHANNEL_NUMBER] =
+{
+    [TEMPERATURE_SENSOR_CHANNEL_CHAMBER] = &tmp117_driver,
+    [TEMPERATURE_SENSOR_CHANNEL_PROBE] = &ds18b20_driver,
+};
+
 static ts_handler_t ts_handler;
 
-static HAL_StatusTypeDef send_command(uint8_t reg, uint16_t value);
-static HAL_StatusTypeDef read_register(uint8_t reg, uint16_t *value);
-static HAL_StatusTypeDef reset_flags(void);
-static HAL_StatusTypeDef update_temperature(void);
-static void handle_error(void);
+static StaticTask_t temperature_task_control_block;
+static StackType_t temperature_task_stack[TEMPERATURE_TASK_STACK_SIZE / sizeof(StackType_t)];
+
+static void store_temperature(temperature_sensor_channel_t channel, float temperature);
+static uint32_t service_channel(temperature_sensor_channel_t channel, uint32_t now);
 static void temperature_task(void *argument);
 static void temeprature_sensor_trigger_alarm(void);
+static void publish_alarm(bool active);
 
-void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+void temperature_sensor_pin_interrupt(uint16_t GPIO_Pin)
 {
     if (GPIO_Pin == TEMPERATURE_SENSOR_INT_Pin)
     {
-    	if(ts_handler.alarm_handler.alarm == false)
+    	if(temperature_sensor_is_alarm_triggered() == false)
     	{
     		//temeprature_sensor_trigger_alarm();
-        	reset_flags();
+        	tmp117_reset_flags();
     	}
     }
 }
 
 bool temperature_sensor_init(void)
 {
-    bool init_ok = false;
+    bool init_ok = true;
     bool task_ok = false;
-    bool mutex_ok = false;
-
-    ts_handler.temperature_handler.temperature = NAN;
-    ts_handler.alarm_handler.alarm = false;
 
-    ts_handler.temperature_handler.temperature_mutex = osMutexNew(NULL);
-    if (ts_handler.temperature_handler.temperature_mutex != NULL)
+    for (int i = 0; i < TEMPERATURE_SENSOR_CHANNEL_NUMBER; i++)
     {
-    	ts_handler.alarm_handler.alarm_mutex = osMutexNew(NULL);
-    	if(ts_handler.alarm_handler.alarm_mutex != NULL)
-    	{
-    		 mutex_ok = true;
-    	}
-    }
+        channel_handler_t *channel = &ts_handler.temperature_handler.channels[i];
+        temperature_channel_sample_t *sample = &ts_handler.temperature_handler.samples.channels[i];
 
-    uint16_t config = (TMP117_MODE_CONTINUOUS << 10);
-    init_ok = (send_command(TMP117_CONFIGURATION_REGISTER, config) == HAL_OK);
+        sample->temperature = NAN;
+        sample->sample_tick = osKernelGetTickCount();
+        sample->timestamp = 0;
+
+        channel->driver = channel_drivers[i];
+        channel->next_start_tick = 0;
+        channel->state = CHANNEL_STATE_DISABLED;
+
+        if (channel->driver->init())
+        {
+            channel->state = CHANNEL_STATE_IDLE;
+        }
+        else
+        {
+            init_ok = false;
+        }
+    }
 
     const osThreadAttr_t task_attributes =
     {
         .name = "TemperatureTask",
         .priority = osPriorityNormal,
-        .stack_size = 254 * 4
+        .cb_mem = &temperature_task_control_block,
+        .cb_size = sizeof(temperature_task_control_block),
+        .stack_mem = temperature_task_stack,
+        .stack_size = sizeof(temperature_task_stack)
     };
 
+    /* Readers see NAN rather than nothing until the first conversion. */
+    bool publish_ok = data_bus_publish(DATA_BUS_TOPIC_TEMPERATURE, &ts_handler.temperature_handler.samples, sizeof(ts_handler.temperature_handler.samples));
+    publish_alarm(false);
+
     ts_handler.task_handle = osThreadNew(temperature_task, NULL, &task_attributes);
-    task_ok = (ts_handler.task_handle != NULL);
+    task_ok = (ts_handler.task_handle != NULL) && stack_monitor_register(ts_handler.task_handle, sizeof(temperature_task_stack));
 
-    return init_ok && task_ok && mutex_ok;
+    return init_ok && task_ok && publish_ok;
 }
 
 float temperature_sensor_get_temperature(void)
 {
-    float temperature = NAN;
+    return temperature_sensor_get_channel_temperature(TEMPERATURE_SENSOR_CHANNEL_CHAMBER);
+}
 
-    if (osMutexAcquire(ts_handler.temperature_handler.temperature_mutex, osWaitForever) == osOK)
-    {
-        temperature = ts_handler.temperature_handler.temperature;
+float temperature_sensor_get_channel_temperature(temperature_sensor_channel_t channel)
+{
+    temperature_samples_t samples;
 
-        if(osOK != osMutexRelease(ts_handler.temperature_handler.temperature_mutex))
-        {
-        	handle_error();
-        }
-    }
-    else
+    if (channel >= TEMPERATURE_SENSOR_CHANNEL_NUMBER || data_bus_read(DATA_BUS_TOPIC_TEMPERATURE, &samples, sizeof(samples)) == 0)
     {
-    	handle_error();
+        return NAN;
     }
 
-    return temperature;
+    return samples.channels[channel].temperature;
 }
 
-HAL_StatusTypeDef temperature_sensor_set_alarm(float high_temperature, float low_temperature)
+/* The age counts from the last valid reading, or from init if there was none yet; the timestamp is that reading's. */
+bool temperature_sensor_get_channel_sample(temperature_sensor_channel_t channel, temperature_sample_t *sample)
 {
-    uint16_t high_temperature_value = (uint16_t)(high_temperature / 0.0078125f);
-    uint16_t low_temperature_value = (uint16_t)(low_temperature / 0.0078125f);
-
-    uint16_t config;
+    temperature_samples_t samples;
 
-    if (read_register(TMP117_CONFIGURATION_REGISTER, &config) != HAL_OK)
+    if (channel >= TEMPERATURE_SENSOR_CHANNEL_NUMBER || data_bus_read(DATA_BUS_TOPIC_TEMPERATURE, &samples, sizeof(samples)) == 0)
     {
-        return HAL_ERROR;
+        return false;
     }
 
-    config &= ~(1 << ALERT_MODE_BIT_POSITION);
-    config &= ~(3 << MOD_BITS_POSITION);
+    const temperature_channel_sample_t *channel_sample = &samples.channels[channel];
 
-    if (send_command(TMP117_CONFIGURATION_REGISTER, config) != HAL_OK)
-    {
-        return HAL_ERROR;
-    }
+    sample->temperature = channel_sample->temperature;
+    sample->age_ms = (osKernelGetTickCount() - channel_sample->sample_tick) * 1000 / osKernelGetTickFreq();
+    sample->timestamp = channel_sample->timestamp;
+
+    return true;
+}
 
-    if (send_command(TMP117_HIGH_TEMPERATURE_REGISTER, high_temperature_value) != HAL_OK)
+const char *temperature_sensor_get_channel_name(temperature_sensor_channel_t channel)
+{
+    if (channel >= TEMPERATURE_SENSOR_CHANNEL_NUMBER)
     {
-        return HAL_ERROR;
+        return NULL;
     }
 
-    if (send_command(TMP117_LOW_TEMPERATURE_REGISTER, low_temperature_value) != HAL_OK)
+    return channel_drivers[channel]->name;
+}
+
+bool temperature_sensor_get_channel_capabilities(temperature_sensor_channel_t channel, temperature_sensor_capabilities_t *capabilities)
+{
+    if (channel >= TEMPERATURE_SENSOR_CHANNEL_NUMBER || capabilities == NULL)
     {
-        return HAL_ERROR;
+        return false;
     }
 
-    return HAL_OK;
+    *capabilities = channel_drivers[channel]->capabilities;
+
+    return true;
 }
 
-bool temperature_sensor_is_alarm_triggered(void)
+HAL_StatusTypeDef temperature_sensor_set_alarm(float high_temperature, float low_temperature)
 {
-	bool result = true;
+    return tmp117_set_alarm(high_temperature, low_temperature);
+}
 
-    if (osMutexAcquire(ts_handler.alarm_handler.alarm_mutex, osWaitForever) == osOK)
-    {
-        result = ts_handler.alarm_handler.alarm;
+/* Reports an alarm when there is no alarm state yet, the same as before the alarm is cleared. */
+bool temperature_sensor_is_alarm_triggered(void)
+{
+    temperature_alarm_t alarm;
 
-        if(osOK != osMutexRelease(ts_handler.alarm_handler.alarm_mutex))
-        {
-        	handle_error();
-        }
-    }
-    else
+    if (data_bus_read(DATA_BUS_TOPIC_ALARM, &alarm, sizeof(alarm)) == 0)
     {
-    	handle_error();
+        return true;
     }
 
-	return result;
+    return alarm.active;
 }
 
 void temperature_sensor_clear_alarm(void)
 {
-    if (osMutexAcquire(ts_handler.alarm_handler.alarm_mutex, osWaitForever) == osOK)
-    {
-    	ts_handler.alarm_handler.alarm = false;
-
-        if(osOK != osMutexRelease(ts_handler.alarm_handler.alarm_mutex))
-        {
-        	handle_error();
-        }
-    }
-    else
-    {
-    	handle_error();
-    }
+    publish_alarm(false);
 }
 
-static HAL_StatusTypeDef reset_flags(void)
+/* Only the temperature task writes the samples, the bus hands out copies. */
+static void store_temperature(temperature_sensor_channel_t channel, float temperature)
 {
-	HAL_StatusTypeDef status = HAL_ERROR;
-    uint16_t config = 0U;
+    temperature_samples_t *samples = &ts_handler.temperature_handler.samples;
 
-    status = read_register(TMP117_CONFIGURATION_REGISTER, &config);
+    samples->channels[channel].temperature = temperature;
+    samples->updated = channel;
 
-    return status;
+    if (!isnan(temperature))
+    {
+        samples->channels[channel].sample_tick = osKernelGetTickCount();
+        samples->channels[channel].timestamp = rtc_get_timestamp();
+    }
+
+    data_bus_publish(DATA_BUS_TOPIC_TEMPERATURE, samples, sizeof(*samples));
 }
 
-static HAL_StatusTypeDef update_temperature(void)
+/* Advances one channel's state machine and returns ticks until it needs service again. */
+static uint32_t service_channel(temperature_sensor_channel_t channel, uint32_t now)
 {
-    HAL_StatusTypeDef status;
-    uint16_t raw_temp;
-    float calculated_temp;
+    channel_handler_t *handler = &ts_handler.temperature_handler.channels[channel];
+    const temperature_sensor_capabilities_t *capabilities = &handler->driver->capabilities;
+    uint32_t conversion_ticks = pdMS_TO_TICKS(capabilities->conversion_time_ms);
+    uint32_t period_ticks = pdMS_TO_TICKS(capabilities->sample_period_ms);
 
-    status = read_register(TMP117_TEMPERATURE_RESULT_REGISTER, &raw_temp);
-
-    if (status == HAL_OK)
+    if (handler->state == CHANNEL_STATE_IDLE && (int32_t)(now - handler->next_start_tick) >= 0)
     {
-        calculated_temp = (float)((int16_t)raw_temp) * 0.0078125f;
+        handler->conversion_start_tick = now;
+        handler->next_start_tick = now + period_ticks;
 
-        if (osMutexAcquire(ts_handler.temperature_handler.temperature_mutex, osWaitForever) == osOK)
+        if (handler->driver->start_conversion())
         {
-            ts_handler.temperature_handler.temperature = calculated_temp;
-
-            if(osOK != osMutexRelease(ts_handler.temperature_handler.temperature_mutex))
-            {
-            	handle_error();
-            }
+            handler->state = CHANNEL_STATE_CONVERTING;
         }
         else
         {
-        	handle_error();
+            store_temperature(channel, NAN);
         }
     }
 
-    return status;
-}
+    if (handler->state == CHANNEL_STATE_CONVERTING && (now - handler->conversion_start_tick) >= conversion_ticks)
+    {
+        float temperature = NAN;
 
-static void temperature_task(void *argument)
-{
-    (void)argument;
+        if (!handler->driver->read(&temperature))
+        {
+            temperature = NAN;
+        }
 
-    for(;;)
+        store_temperature(channel, temperature);
+        handler->state = CHANNEL_STATE_IDLE;
+    }
+
+    switch (handler->state)
     {
-        update_temperature();
-        osDelay(100);
+        case CHANNEL_STATE_CONVERTING:
+            return conversion_ticks - (now - handler->conversion_start_tick);
+        case CHANNEL_STATE_IDLE:
+            return ((int32_t)(handler->next_start_tick - now) > 0) ? handler->next_start_tick - now : 0;
+        default:
+            return UINT32_MAX;
     }
 }
 
-static HAL_StatusTypeDef send_command(uint8_t reg, uint16_t value)
+static void temperature_task(void *argument)
 {
-	HAL_StatusTypeDef status = HAL_ERROR;
-    uint8_t data[2];
-
-    data[0] = (value >> 8) & 0xFF;
-    data[1] = value & 0xFF;
+    (void)argument;
 
-    status = HAL_I2C_Mem_Write(&I2C_HANDLE, TMP117_I2C_ADDRESS, reg, I2C_MEMADD_SIZE_8BIT, data, 2, HAL_MAX_DELAY);
+    for(;;)
+    {
+        uint32_t now = osKernelGetTickCount();
+        uint32_t wait_ticks = UINT32_MAX;
 
-    return status;
-}
+        for (int i = 0; i < TEMPERATURE_SENSOR_CHANNEL_NUMBER; i++)
+        {
+            uint32_t channel_wait = service_channel((temperature_sensor_channel_t)i, now);
 
-static HAL_StatusTypeDef read_register(uint8_t reg, uint16_t *value)
-{
-	HAL_StatusTypeDef status = HAL_ERROR;
-    uint8_t data[2];
+            if (channel_wait < wait_ticks)
+            {
+                wait_ticks = channel_wait;
+            }
+        }
 
-    status = HAL_I2C_Mem_Read(&I2C_HANDLE, TMP117_I2C_ADDRESS, reg, I2C_MEMADD_SIZE_8BIT, data, 2, HAL_MAX_DELAY);
+        if (wait_ticks == UINT32_MAX)
+        {
+            wait_ticks = pdMS_TO_TICKS(1000);
+        }
 
-    if (status == HAL_OK)
-    {
-    	*value = (data[0] << 8) | data[1];
+        osDelay(wait_ticks > 0 ? wait_ticks : 1);
     }
-
-    return status;
 }
 
 static void temeprature_sensor_trigger_alarm(void)
 {
-    if (osMutexAcquire(ts_handler.alarm_handler.alarm_mutex, osWaitForever) == osOK)
-    {
-    	ts_handler.alarm_handler.alarm = true;
-
-        if(osOK != osMutexRelease(ts_handler.alarm_handler.alarm_mutex))
-        {
-        	handle_error();
-        }
-    }
-    else
-    {
-    	handle_error();
-    }
+    publish_alarm(true);
 }
 
-static void handle_error(void)
+static void publish_alarm(bool active)
 {
-	HAL_GPIO_WritePin(HEATER_ON_GPIO_Port, HEATER_ON_Pin, GPIO_PIN_RESET);
-	__asm volatile("BKPT #0");
-}
+    const temperature_alarm_t alarm = { .active = active, .timestamp = rtc_get_timestamp() };
 
+    data_bus_publish(DATA_BUS_TOPIC_ALARM, &alarm, sizeof(alarm));
+}
@@ -3,9 +3,52 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "stm32l4xx_hal.h"
+#include "temperature_sensor_driver.h"
+#include "rtc_module.h"
+
+typedef enum
+{
+    TEMPERATURE_SENSOR_CHANNEL_CHAMBER,
+    TEMPERATURE_SENSOR_CHANNEL_PROBE,
+
+    TEMPERATURE_SENSOR_CHANNEL_NUMBER,
+} temperature_sensor_channel_t;
+
+typedef struct
+{
+    float temperature;
+    uint32_t age_ms;
+    rtc_timestamp_t timestamp;
+} temperature_sample_t;
+
+typedef struct
+{
+    float temperature;         /* NAN after a failed reading */
+    uint32_t sample_tick;      /* kernel tick of the last valid reading, or of init */
+    rtc_timestamp_t timestamp; /* RTC time of the last valid reading */
+} temperature_channel_sample_t;
+
+/* Data bus TEMPERATURE payload: every channel, published whenever one of them is read. */
+typedef struct
+{
+    temperature_channel_sample_t channels[TEMPERATURE_SENSOR_CHANNEL_NUMBER];
+    temperature_sensor_channel_t updated;
+} temperature_samples_t;
+
+/* Data bus ALARM payload, published when the alarm is raised or cleared. */
+typedef struct
+{
+    bool active;
+    rtc_timestamp_t timestamp;
+} temperature_alarm_t;
 
 bool temperature_sensor_init(void);
 float temperature_sensor_get_temperature(void);
+float temperature_sensor_get_channel_temperature(temperature_sensor_channel_t channel);
+bool temperature_sensor_get_channel_sample(temperature_sensor_channel_t channel, temperature_sample_t *sample);
+const char *temperature_sensor_get_channel_name(temperature_sensor_channel_t channel);
+bool temperature_sensor_get_channel_capabilities(temperature_sensor_channel_t channel, temperature_sensor_capabilities_t *capabilities);
 HAL_StatusTypeDef temperature_sensor_set_alarm(float high_temperature, float low_temperature);
 bool temperature_sensor_is_alarm_triggered(void);
-void temperature_sensor_clear_alarm(void);
\ No newline at end of file
+void temperature_sensor_clear_alarm(void);
+void temperature_sensor_pin_interrupt(uint16_t GPIO_Pin);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+    float resolution;
+    uint32_t conversion_time_ms;
+    uint32_t sample_period_ms;
+} temperature_sensor_capabilities_t;
+
+typedef struct
+{
+    const char *name;
+    bool (*init)(void);
+    bool (*start_conversion)(void);
+    bool (*read)(float *temperature);
+    temperature_sensor_capabilities_t capabilities;
+} temperature_sensor_driver_t;
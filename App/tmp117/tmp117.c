@@ -0,0 +1,146 @@
+/**
+ * TMP117 temperature sensor driver
+ */
+
+#include "tmp117.h"
+
+#include "main.h"
+
+#define I2C_HANDLE hi2c1
+extern I2C_HandleTypeDef I2C_HANDLE;
+
+#define TMP117_I2C_ADDRESS (0x48 << 1)
+
+#define TMP117_TEMPERATURE_RESULT_REGISTER   0x00
+#define TMP117_CONFIGURATION_REGISTER        0x01
+#define TMP117_HIGH_TEMPERATURE_REGISTER     0x02
+#define TMP117_LOW_TEMPERATURE_REGISTER      0x03
+
+#define TMP117_MODE_CONTINUOUS   0x00
+#define TMP117_MODE_SHUTDOWN     0x01
+#define TMP117_MODE_ONE_SHOT     0x03
+
+#define TMP117_AVERAGING_8       0x01
+
+#define TMP117_RESOLUTION        0.0078125f
+#define TMP117_CYCLE_TIME_MS     125
+
+#define ALERT_MODE_BIT_POSITION     4
+#define AVG_BITS_POSITION           5
+#define MOD_BITS_POSITION           10
+
+static bool tmp117_init(void);
+static bool tmp117_start_conversion(void);
+static bool tmp117_read(float *temperature);
+static HAL_StatusTypeDef send_command(uint8_t reg, uint16_t value);
+static HAL_StatusTypeDef read_register(uint8_t reg, uint16_t *value);
+
+const temperature_sensor_driver_t tmp117_driver =
+{
+    .name = "TMP117",
+    .init = tmp117_init,
+    .start_conversion = tmp117_start_conversion,
+    .read = tmp117_read,
+    .capabilities =
+    {
+        .resolution = TMP117_RESOLUTION,
+        .conversion_time_ms = TMP117_CYCLE_TIME_MS,
+        .sample_period_ms = TMP117_CYCLE_TIME_MS,
+    },
+};
+
+HAL_StatusTypeDef tmp117_set_alarm(float high_temperature, float low_temperature)
+{
+    uint16_t high_temperature_value = (uint16_t)(high_temperature / TMP117_RESOLUTION);
+    uint16_t low_temperature_value = (uint16_t)(low_temperature / TMP117_RESOLUTION);
+
+    uint16_t config;
+
+    if (read_register(TMP117_CONFIGURATION_REGISTER, &config) != HAL_OK)
+    {
+        return HAL_ERROR;
+    }
+
+    config &= ~(1 << ALERT_MODE_BIT_POSITION);
+    config &= ~(3 << MOD_BITS_POSITION);
+
+    if (send_command(TMP117_CONFIGURATION_REGISTER, config) != HAL_OK)
+    {
+        return HAL_ERROR;
+    }
+
+    if (send_command(TMP117_HIGH_TEMPERATURE_REGISTER, high_temperature_value) != HAL_OK)
+    {
+        return HAL_ERROR;
+    }
+
+    if (send_command(TMP117_LOW_TEMPERATURE_REGISTER, low_temperature_value) != HAL_OK)
+    {
+        return HAL_ERROR;
+    }
+
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef tmp117_reset_flags(void)
+{
+    uint16_t config = 0U;
+
+    return read_register(TMP117_CONFIGURATION_REGISTER, &config);
+}
+
+static bool tmp117_init(void)
+{
+    uint16_t config = (TMP117_MODE_CONTINUOUS << MOD_BITS_POSITION) |
+                      (TMP117_AVERAGING_8 << AVG_BITS_POSITION);
+
+    return send_command(TMP117_CONFIGURATION_REGISTER, config) == HAL_OK;
+}
+
+static bool tmp117_start_conversion(void)
+{
+    /* Continuous mode, the sensor converts on its own cycle. */
+    return true;
+}
+
+static bool tmp117_read(float *temperature)
+{
+    uint16_t raw_temp;
+
+    if (read_register(TMP117_TEMPERATURE_RESULT_REGISTER, &raw_temp) != HAL_OK)
+    {
+        return false;
+    }
+
+    *temperature = (float)((int16_t)raw_temp) * TMP117_RESOLUTION;
+
+    return true;
+}
+
+static HAL_StatusTypeDef send_command(uint8_t reg, uint16_t value)
+{
+	HAL_StatusTypeDef status = HAL_ERROR;
+    uint8_t data[2];
+
+    data[0] = (value >> 8) & 0xFF;
+    data[1] = value & 0xFF;
+
+    status = HAL_I2C_Mem_Write(&I2C_HANDLE, TMP117_I2C_ADDRESS, reg, I2C_MEMADD_SIZE_8BIT, data, 2, HAL_MAX_DELAY);
+
+    return status;
+}
+
+static HAL_StatusTypeDef read_register(uint8_t reg, uint16_t *value)
+{
+	HAL_StatusTypeDef status = HAL_ERROR;
+    uint8_t data[2];
+
+    status = HAL_I2C_Mem_Read(&I2C_HANDLE, TMP117_I2C_ADDRESS, reg, I2C_MEMADD_SIZE_8BIT, data, 2, HAL_MAX_DELAY);
+
+    if (status == HAL_OK)
+    {
+    	*value = (data[0] << 8) | data[1];
+    }
+
+    return status;
+}
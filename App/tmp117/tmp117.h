@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "stm32l4xx_hal.h"
+#include "temperature_sensor_driver.h"
+
+extern const temperature_sensor_driver_t tmp117_driver;
+
+HAL_StatusTypeDef tmp117_set_alarm(float high_temperature, float low_temperature);
+HAL_StatusTypeDef tmp117_reset_flags(void);
@@ -66,6 +66,11 @@ void Error_Handler(void);
 #define LCD_MOSI_GPIO_Port GPIOA
 #define HEATER_ON_Pin GPIO_PIN_4
 #define HEATER_ON_GPIO_Port GPIOC
+#define HEATER_2_ON_Pin GPIO_PIN_5
+#define HEATER_2_ON_GPIO_Port GPIOC
+#define ZERO_CROSS_Pin GPIO_PIN_6
+#define ZERO_CROSS_GPIO_Port GPIOC
+#define ZERO_CROSS_EXTI_IRQn EXTI9_5_IRQn
 #define LCD_CS_Pin GPIO_PIN_10
 #define LCD_CS_GPIO_Port GPIOA
 #define LCD_DC_Pin GPIO_PIN_3
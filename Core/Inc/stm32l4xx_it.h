@@ -52,10 +52,15 @@ void MemManage_Handler(void);
 void BusFault_Handler(void);
 void UsageFault_Handler(void);
 void DebugMon_Handler(void);
+void RTC_WKUP_IRQHandler(void);
 void EXTI3_IRQHandler(void);
 void DMA1_Channel3_IRQHandler(void);
+void EXTI9_5_IRQHandler(void);
 void TIM1_UP_TIM16_IRQHandler(void);
+void TIM3_IRQHandler(void);
+void RTC_Alarm_IRQHandler(void);
 /* USER CODE BEGIN EFP */
+void LPTIM1_IRQHandler(void);
 
 /* USER CODE END EFP */
 
@@ -31,16 +31,25 @@
 #include "display.h"
 #include "heater.h"
 #include "rtc_module.h"
+#include "rtc_calibration.h"
+#include "scheduler.h"
+#include "retention.h"
+#include "low_power.h"
+#include "runtime_stats.h"
+#include "stack_monitor.h"
+#include "data_bus.h"
 
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
+typedef StaticTask_t osStaticThreadDef_t;
 /* USER CODE BEGIN PTD */
 
 /* USER CODE END PTD */
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+#define DEFAULT_TASK_FLAG_ALARM 0x01u
 
 /* USER CODE END PD */
 
@@ -57,9 +66,14 @@ float temperature = 0.0f;
 /* USER CODE END Variables */
 /* Definitions for defaultTask */
 osThreadId_t defaultTaskHandle;
+uint32_t defaultTaskBuffer[ 128 ];
+osStaticThreadDef_t defaultTaskControlBlock;
 const osThreadAttr_t defaultTask_attributes = {
   .name = "defaultTask",
-  .stack_size = 128 * 4,
+  .cb_mem = &defaultTaskControlBlock,
+  .cb_size = sizeof(defaultTaskControlBlock),
+  .stack_mem = &defaultTaskBuffer[0],
+  .stack_size = sizeof(defaultTaskBuffer),
   .priority = (osPriority_t) osPriorityNormal,
 };
 
@@ -72,6 +86,34 @@ void StartDefaultTask(void *argument);
 
 void MX_FREERTOS_Init(void); /* (MISRA C 2004 rule 8.1) */
 
+/* Hook prototypes */
+void configureTimerForRunTimeStats(void);
+unsigned long getRunTimeCounterValue(void);
+void vApplicationStackOverflowHook(xTaskHandle xTask, signed char *pcTaskName);
+
+/* USER CODE BEGIN 1 */
+/* Functions needed when configGENERATE_RUN_TIME_STATS is on */
+void configureTimerForRunTimeStats(void)
+{
+  runtime_stats_start_counter();
+}
+
+unsigned long getRunTimeCounterValue(void)
+{
+  return runtime_stats_get_counter();
+}
+/* USER CODE END 1 */
+
+/* USER CODE BEGIN 4 */
+void vApplicationStackOverflowHook(xTaskHandle xTask, signed char *pcTaskName)
+{
+   /* Run time stack overflow checking is performed if
+   configCHECK_FOR_STACK_OVERFLOW is defined to 1 or 2. This hook function is
+   called if a stack overflow is detected. */
+   stack_monitor_overflow((const char *)pcTaskName);
+}
+/* USER CODE END 4 */
+
 /**
   * @brief  FreeRTOS initialization
   * @param  None
@@ -122,20 +164,30 @@ void MX_FREERTOS_Init(void) {
 void StartDefaultTask(void *argument)
 {
   /* USER CODE BEGIN StartDefaultTask */
+	retention_init();
+	stack_monitor_init();
+	stack_monitor_register(defaultTaskHandle, sizeof(defaultTaskBuffer));
 	temperature_sensor_init();
 	rtc_init();
+	rtc_calibration_init();
+	low_power_init();
+	runtime_stats_init();
 	display_init();
 	heater_init();
+	scheduler_init();
+
+	/* Woken only when the alarm changes, so the task adds no periodic wake-ups to tickless idle. */
+	data_bus_subscribe(DATA_BUS_TOPIC_ALARM, defaultTaskHandle, DEFAULT_TASK_FLAG_ALARM);
 
   /* Infinite loop */
   for(;;)
   {
+      osThreadFlagsWait(DEFAULT_TASK_FLAG_ALARM, osFlagsWaitAny, osWaitForever);
+
 	 /* if(temperature_sensor_is_alarm_triggered())
 	  {
 		 // heater_turn_off();
 	  }*/
-
-      osDelay(100);
   }
   /* USER CODE END StartDefaultTask */
 }
@@ -28,6 +28,8 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "heater_output.h"
+#include "temperature_sensor.h"
 
 /* USER CODE END Includes */
 
@@ -100,6 +102,7 @@ int main(void)
   MX_SPI1_Init();
   MX_TIM2_Init();
   MX_RTC_Init();
+  MX_TIM3_Init();
   /* USER CODE BEGIN 2 */
 
   /* USER CODE END 2 */
@@ -178,6 +181,11 @@ void SystemClock_Config(void)
 }
 
 /* USER CODE BEGIN 4 */
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+  temperature_sensor_pin_interrupt(GPIO_Pin);
+  heater_output_zero_cross(GPIO_Pin);
+}
 
 /* USER CODE END 4 */
 
@@ -198,6 +206,7 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
     HAL_IncTick();
   }
   /* USER CODE BEGIN Callback 1 */
+  heater_output_period_elapsed(htim);
 
   /* USER CODE END Callback 1 */
 }
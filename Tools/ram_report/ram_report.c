@@ -0,0 +1,221 @@
+/**
+ * RAM budget report of the statically allocated RTOS objects
+ *
+ * Reads the symbol table of the firmware image and lists the stack and
+ * control block of every task, the mutex and queue memory, the FreeRTOS
+ * heap and the total of all static RAM. Objects are recognised by the
+ * naming used in App/ and by CubeMX:
+ *   <name>_task_stack, <name>_task_control_block        (App modules)
+ *   <name>TaskBuffer, <name>TaskControlBlock            (CubeMX tasks)
+ *   Idle_Stack, Idle_TCB, Timer_Stack, Timer_TCB        (cmsis_os2.c)
+ *   <name>_mutex_control_block
+ *   <name>_queue_control_block, <name>_queue_storage
+ *
+ * Build once, then run after every firmware build from the repository root:
+ *   gcc -O2 -std=c11 Tools/ram_report/ram_report.c -o ram_report
+ *   arm-none-eabi-nm -S Debug/STM32L476_HeatingChamber.elf | ./ram_report
+ *
+ * Exits with a non-zero status when no RAM symbols were found.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NAME 128
+#define MAX_TASKS 32
+
+#define SRAM1_START 0x20000000ul
+#define SRAM1_END   0x20018000ul
+#define SRAM2_START 0x10000000ul
+#define SRAM2_END   0x10008000ul
+
+typedef enum
+{
+    KIND_STACK,
+    KIND_TCB,
+    KIND_MUTEX,
+    KIND_QUEUE,
+    KIND_HEAP,
+
+    KIND_NUMBER,
+} kind_t;
+
+typedef struct
+{
+    const char *suffix;
+    kind_t kind;
+} pattern_t;
+
+typedef struct
+{
+    char name[MAX_NAME];
+    unsigned long stack;
+    unsigned long tcb;
+} task_t;
+
+static const pattern_t patterns[] =
+{
+    { "_task_stack", KIND_STACK },
+    { "TaskBuffer", KIND_STACK },
+    { "_Stack", KIND_STACK },
+    { "_task_control_block", KIND_TCB },
+    { "TaskControlBlock", KIND_TCB },
+    { "_TCB", KIND_TCB },
+    { "_mutex_control_block", KIND_MUTEX },
+    { "_queue_control_block", KIND_QUEUE },
+    { "_queue_storage", KIND_QUEUE },
+    { "ucHeap", KIND_HEAP },
+};
+
+static task_t tasks[MAX_TASKS];
+static int task_count;
+static unsigned long kind_total[KIND_NUMBER];
+static int mutex_count;
+static int queue_count;
+
+static task_t *find_task(const char *name)
+{
+    for (int i = 0; i < task_count; i++)
+    {
+        if (strcmp(tasks[i].name, name) == 0)
+        {
+            return &tasks[i];
+        }
+    }
+
+    if (task_count == MAX_TASKS)
+    {
+        return NULL;
+    }
+
+    task_t *task = &tasks[task_count++];
+    snprintf(task->name, sizeof(task->name), "%s", name);
+    return task;
+}
+
+/* Function-local statics get a numeric suffix such as Idle_Stack.0. */
+static void strip_local_suffix(char *name)
+{
+    char *dot = strrchr(name, '.');
+
+    if (dot != NULL && dot[1] != '\0' && strspn(dot + 1, "0123456789") == strlen(dot + 1))
+    {
+        *dot = '\0';
+    }
+}
+
+static void classify(const char *name, unsigned long size)
+{
+    size_t length = strlen(name);
+
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++)
+    {
+        size_t suffix_length = strlen(patterns[i].suffix);
+
+        if (length < suffix_length || strcmp(name + length - suffix_length, patterns[i].suffix) != 0)
+        {
+            continue;
+        }
+
+        kind_t kind = patterns[i].kind;
+        kind_total[kind] += size;
+
+        if (kind == KIND_STACK || kind == KIND_TCB)
+        {
+            char prefix[MAX_NAME];
+            snprintf(prefix, sizeof(prefix), "%.*s", (int)(length - suffix_length), name);
+
+            task_t *task = find_task(prefix);
+            if (task != NULL)
+            {
+                if (kind == KIND_STACK) task->stack += size;
+                else task->tcb += size;
+            }
+        }
+        else if (kind == KIND_MUTEX)
+        {
+            mutex_count++;
+        }
+        else if (kind == KIND_QUEUE && strcmp(patterns[i].suffix, "_queue_control_block") == 0)
+        {
+            queue_count++;
+        }
+
+        return;
+    }
+}
+
+static int compare_tasks(const void *a, const void *b)
+{
+    return strcmp(((const task_t *)a)->name, ((const task_t *)b)->name);
+}
+
+int main(void)
+{
+    char line[512];
+    unsigned long sram1_total = 0;
+    unsigned long sram2_total = 0;
+
+    while (fgets(line, sizeof(line), stdin) != NULL)
+    {
+        unsigned long address;
+        unsigned long size;
+        char type;
+        char name[MAX_NAME];
+
+        /* Symbols without a size have only three fields and are skipped. */
+        if (sscanf(line, "%lx %lx %c %127s", &address, &size, &type, name) != 4)
+        {
+            continue;
+        }
+
+        if (type != 'b' && type != 'B' && type != 'd' && type != 'D')
+        {
+            continue;
+        }
+
+        if (address >= SRAM1_START && address < SRAM1_END)
+        {
+            sram1_total += size;
+        }
+        else if (address >= SRAM2_START && address < SRAM2_END)
+        {
+            sram2_total += size;
+        }
+        else
+        {
+            continue;
+        }
+
+        strip_local_suffix(name);
+        classify(name, size);
+    }
+
+    if (sram1_total == 0 && sram2_total == 0)
+    {
+        fprintf(stderr, "no RAM symbols found, pipe in the output of nm -S\n");
+        return 1;
+    }
+
+    qsort(tasks, task_count, sizeof(tasks[0]), compare_tasks);
+
+    printf("%-24s %8s %8s\n", "task", "stack", "tcb");
+    for (int i = 0; i < task_count; i++)
+    {
+        printf("%-24s %8lu %8lu\n", tasks[i].name, tasks[i].stack, tasks[i].tcb);
+    }
+
+    unsigned long rtos_total = kind_total[KIND_STACK] + kind_total[KIND_TCB] + kind_total[KIND_MUTEX] + kind_total[KIND_QUEUE] + kind_total[KIND_HEAP];
+
+    printf("\n");
+    printf("%-24s %8lu %8lu  (%d tasks)\n", "tasks total", kind_total[KIND_STACK], kind_total[KIND_TCB], task_count);
+    printf("%-24s %8lu  (%d)\n", "mutexes", kind_total[KIND_MUTEX], mutex_count);
+    printf("%-24s %8lu  (%d)\n", "queues", kind_total[KIND_QUEUE], queue_count);
+    printf("%-24s %8lu\n", "FreeRTOS heap", kind_total[KIND_HEAP]);
+    printf("%-24s %8lu\n", "RTOS objects total", rtos_total);
+    printf("%-24s %8lu\n", "static RAM, SRAM1", sram1_total);
+    printf("%-24s %8lu\n", "static RAM, SRAM2", sram2_total);
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+/**
+ * Host check of the burst-fire patterns generated by App/heater/burst_fire.c
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -std=c11 -IApp/heater Tools/thermal_sim/burst_fire_check.c \
+ *       App/heater/burst_fire.c -lm -o burst_fire_check && ./burst_fire_check
+ *
+ * Exits with a non-zero status when a pattern violates its expectations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "burst_fire.h"
+
+#define WINDOW 100
+#define WINDOWS 20
+
+static int failures;
+
+static void expect(int condition, const char *what, int value)
+{
+    if (!condition)
+    {
+        printf("FAIL: %s (%d)\n", what, value);
+        failures++;
+    }
+}
+
+/* One output: exact count per window and pulse spacing within one half-cycle of ideal. */
+static void check_single_output(void)
+{
+    for (int duty = 0; duty <= 100; duty++)
+    {
+        burst_fire_t burst;
+        burst_fire_init(&burst, 1, WINDOW, 1);
+        burst_fire_set_duty(&burst, 0, (float)duty);
+
+        int last_on = -1;
+        int min_gap = WINDOW + 1;
+        int max_gap = 0;
+
+        for (int window = 0; window < WINDOWS; window++)
+        {
+            int count = 0;
+
+            for (int half = 0; half < WINDOW; half++)
+            {
+                int index = window * WINDOW + half;
+
+                if (burst_fire_next_half_cycle(&burst) & 1u)
+                {
+                    count++;
+                    if (last_on >= 0)
+                    {
+                        int gap = index - last_on;
+                        if (gap < min_gap) min_gap = gap;
+                        if (gap > max_gap) max_gap = gap;
+                    }
+                    last_on = index;
+                }
+            }
+
+            expect(count == duty, "half-cycles per window equal the duty", duty);
+        }
+
+        if (duty > 1)
+        {
+            expect(max_gap - min_gap <= 1, "pulses evenly spread", duty);
+        }
+    }
+}
+
+/* Several outputs under a simultaneous-conduction cap. */
+static void check_cap(int outputs, const float *duties, int max_simultaneous, const int *expected)
+{
+    burst_fire_t burst;
+    int count[BURST_FIRE_MAX_OUTPUTS] = { 0 };
+
+    burst_fire_init(&burst, (uint8_t)outputs, WINDOW, (uint8_t)max_simultaneous);
+    for (int i = 0; i < outputs; i++)
+    {
+        burst_fire_set_duty(&burst, (uint8_t)i, duties[i]);
+    }
+
+    for (int half = 0; half < WINDOWS * WINDOW; half++)
+    {
+        uint32_t mask = burst_fire_next_half_cycle(&burst);
+        int on = 0;
+
+        for (int i = 0; i < outputs; i++)
+        {
+            if (mask & (1u << i))
+            {
+                count[i]++;
+                on++;
+            }
+        }
+
+        expect(on <= max_simultaneous, "simultaneous outputs within cap", on);
+    }
+
+    for (int i = 0; i < outputs; i++)
+    {
+        int per_window = (count[i] + WINDOWS / 2) / WINDOWS;
+        expect(abs(per_window - expected[i]) <= 1, "average half-cycles per window", per_window);
+        printf("  output %d: duty %5.1f%% -> %5.1f half-cycles/window\n", i, duties[i], (float)count[i] / WINDOWS);
+    }
+}
+
+int main(void)
+{
+    check_single_output();
+    printf("single output, 0..100%%: %s\n", failures == 0 ? "ok" : "FAILED");
+
+    printf("three outputs at 30%%, one at a time:\n");
+    check_cap(3, (const float[]){ 30.0f, 30.0f, 30.0f }, 1, (const int[]){ 30, 30, 30 });
+
+    printf("two outputs at 60%%, one at a time:\n");
+    check_cap(2, (const float[]){ 60.0f, 60.0f }, 1, (const int[]){ 50, 50 });
+
+    printf("two outputs at 100%% and 20%%, two at a time:\n");
+    check_cap(2, (const float[]){ 100.0f, 20.0f }, 2, (const int[]){ 100, 20 });
+
+    printf("%s\n", failures == 0 ? "all patterns ok" : "pattern check FAILED");
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,150 @@
+/**
+ * Host check of the control loop statistics of App/loop_profiler/loop_profiler.c
+ *
+ * Drives the profiler through its host counter stubs with scripted loop
+ * periods and phase durations, and checks period, jitter and phase
+ * statistics, the jitter histogram, overruns and the 32-bit counter wraps.
+ * The loops sleep between cycles, so the period has to come from the
+ * counter that keeps running while the cycle counter stands still.
+ *
+ * Build and run from the repository root:
+ *   gcc -O2 -std=c11 -IApp/loop_profiler Tools/thermal_sim/loop_profiler_check.c \
+ *       App/loop_profiler/loop_profiler.c -o loop_profiler_check && ./loop_profiler_check
+ *
+ * Exits with a non-zero status when a statistic differs from the expected value.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "loop_profiler.h"
+
+#define NOMINAL_US 1000
+#define BIN_US     50
+
+static int failures;
+
+static void expect(int condition, const char *what, long value)
+{
+    if (!condition)
+    {
+        printf("FAIL: %s (%ld)\n", what, value);
+        failures++;
+    }
+}
+
+/* One loop: sensor read, compute and actuation phases, then asleep for the rest of the period. */
+static void run_loop(loop_profiler_t *profiler, uint32_t period_us, uint32_t compute_us)
+{
+    loop_profiler_loop_start(profiler);
+
+    loop_profiler_phase_begin(profiler, LOOP_PHASE_SENSOR_READ);
+    loop_profiler_stub_advance_us(10);
+    loop_profiler_phase_end(profiler, LOOP_PHASE_SENSOR_READ);
+
+    loop_profiler_phase_begin(profiler, LOOP_PHASE_COMPUTE);
+    loop_profiler_stub_advance_us(compute_us);
+    loop_profiler_phase_end(profiler, LOOP_PHASE_COMPUTE);
+
+    loop_profiler_phase_begin(profiler, LOOP_PHASE_ACTUATION);
+    loop_profiler_stub_advance_us(5);
+    loop_profiler_phase_end(profiler, LOOP_PHASE_ACTUATION);
+
+    loop_profiler_stub_sleep_us(period_us - 15 - compute_us);
+}
+
+/* Periods alternating 100 us early and late give a known mean, spread and histogram. */
+static void check_jitter(void)
+{
+    loop_profiler_t profiler;
+    loop_profile_t profile;
+
+    expect(loop_profiler_init(&profiler, NOMINAL_US, BIN_US), "init", 0);
+
+    for (int i = 0; i < 100; i++)
+    {
+        run_loop(&profiler, (i % 2) ? NOMINAL_US + 100 : NOMINAL_US - 100, 200);
+    }
+    loop_profiler_loop_start(&profiler);
+
+    loop_profiler_get_profile(&profiler, &profile);
+
+    expect(profile.period.count == 100, "period count", profile.period.count);
+    expect(profile.period.min_us == NOMINAL_US - 100, "period min", profile.period.min_us);
+    expect(profile.period.max_us == NOMINAL_US + 100, "period max", profile.period.max_us);
+    expect(loop_profiler_mean_us(&profile.period) == NOMINAL_US, "period mean", loop_profiler_mean_us(&profile.period));
+    expect(profile.jitter.min_us == 100 && profile.jitter.max_us == 100, "jitter min/max", profile.jitter.max_us);
+    expect(profile.jitter_histogram[100 / BIN_US] == 100, "jitter histogram bin", profile.jitter_histogram[100 / BIN_US]);
+    expect(profile.phase[LOOP_PHASE_COMPUTE].count == 100, "compute phase count", profile.phase[LOOP_PHASE_COMPUTE].count);
+    expect(loop_profiler_mean_us(&profile.phase[LOOP_PHASE_COMPUTE]) == 200, "compute phase mean", loop_profiler_mean_us(&profile.phase[LOOP_PHASE_COMPUTE]));
+    expect(profile.phase[LOOP_PHASE_SENSOR_READ].max_us == 10, "sensor phase max", profile.phase[LOOP_PHASE_SENSOR_READ].max_us);
+
+    printf("period %u/%u/%u us, jitter %u us: %s\n", (unsigned)profile.period.min_us, (unsigned)loop_profiler_mean_us(&profile.period),
+           (unsigned)profile.period.max_us, (unsigned)profile.jitter.max_us, failures == 0 ? "ok" : "FAILED");
+}
+
+/* An overrunning compute phase stretches the period; overruns beyond the histogram land in its last bin. */
+static void check_overrun(void)
+{
+    loop_profiler_t profiler;
+    loop_profile_t profile;
+    int before = failures;
+
+    loop_profiler_init(&profiler, NOMINAL_US, BIN_US);
+
+    for (int i = 0; i < 10; i++)
+    {
+        run_loop(&profiler, (i == 4) ? 5 * NOMINAL_US : NOMINAL_US, (i == 4) ? 4900 : 200);
+    }
+    loop_profiler_loop_start(&profiler);
+
+    loop_profiler_get_profile(&profiler, &profile);
+
+    expect(profile.period.max_us == 5 * NOMINAL_US, "overrun period", profile.period.max_us);
+    expect(profile.phase[LOOP_PHASE_COMPUTE].max_us == 4900, "overrun compute phase", profile.phase[LOOP_PHASE_COMPUTE].max_us);
+    expect(profile.jitter_histogram[LOOP_PROFILER_HISTOGRAM_BINS - 1] == 1, "overrun in last bin", profile.jitter_histogram[LOOP_PROFILER_HISTOGRAM_BINS - 1]);
+    expect(profile.jitter_histogram[0] == 9, "on-time loops in first bin", profile.jitter_histogram[0]);
+
+    loop_profiler_reset(&profiler);
+    loop_profiler_get_profile(&profiler, &profile);
+    expect(profile.period.count == 0 && profile.jitter_histogram[LOOP_PROFILER_HISTOGRAM_BINS - 1] == 0, "reset clears", profile.period.count);
+
+    printf("overrun of %u us: %s\n", 4u * NOMINAL_US, failures == before ? "ok" : "FAILED");
+}
+
+/* The cycle counter wraps every 53 s at 80 MHz, the 1 us counter every 71 minutes; periods across both must still be exact. */
+static void check_wrap(void)
+{
+    loop_profiler_t profiler;
+    loop_profile_t profile;
+    int before = failures;
+
+    loop_profiler_stub_set_clock_hz(80000000);
+    loop_profiler_init(&profiler, NOMINAL_US, BIN_US);
+
+    loop_profiler_stub_advance_us(UINT32_MAX - 500000u);
+    for (int i = 0; i < 1000; i++)
+    {
+        run_loop(&profiler, NOMINAL_US, 200);
+    }
+    loop_profiler_loop_start(&profiler);
+
+    loop_profiler_get_profile(&profiler, &profile);
+
+    expect(profile.period.min_us == NOMINAL_US && profile.period.max_us == NOMINAL_US, "period across wrap", profile.period.max_us);
+
+    printf("counter wraps: %s\n", failures == before ? "ok" : "FAILED");
+}
+
+int main(void)
+{
+    loop_profiler_stub_set_clock_hz(80000000);
+
+    check_jitter();
+    check_overrun();
+    check_wrap();
+
+    printf("%s\n", failures == 0 ? "all statistics ok" : "statistics check FAILED");
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,89 @@
+/**
+ * Lumped thermal model of the chamber
+ *
+ * One heat capacity with temperature dependent losses to ambient, a
+ * transport delay between heater and chamber, and a sensor with first
+ * order lag, gaussian noise and quantisation.
+ */
+
+#include "thermal_plant.h"
+
+#include <math.h>
+
+static float next_gaussian(thermal_plant_t *plant);
+
+void thermal_plant_init(thermal_plant_t *plant, const thermal_plant_config_t *config, float initial_temperature, float step_s)
+{
+    plant->config = *config;
+    plant->temperature = initial_temperature;
+    plant->sensor_temperature = initial_temperature;
+    plant->loss_factor = 1.0f;
+
+    plant->delay_steps = (uint32_t)(config->transport_delay_s / step_s);
+    if (plant->delay_steps >= THERMAL_PLANT_MAX_DELAY_STEPS)
+    {
+        plant->delay_steps = THERMAL_PLANT_MAX_DELAY_STEPS - 1;
+    }
+
+    for (uint32_t i = 0; i < THERMAL_PLANT_MAX_DELAY_STEPS; i++)
+    {
+        plant->delay_line[i] = 0.0f;
+    }
+
+    plant->delay_index = 0;
+    plant->noise_state = 0x12345678u;
+}
+
+void thermal_plant_step(thermal_plant_t *plant, float heater_fraction, float step_s)
+{
+    const thermal_plant_config_t *config = &plant->config;
+    float delayed_fraction = heater_fraction;
+
+    if (plant->delay_steps > 0)
+    {
+        delayed_fraction = plant->delay_line[plant->delay_index];
+        plant->delay_line[plant->delay_index] = heater_fraction;
+        plant->delay_index = (plant->delay_index + 1) % plant->delay_steps;
+    }
+
+    float rise = plant->temperature - config->ambient_temperature;
+    float loss = plant->loss_factor * (config->loss_coefficient + config->loss_slope * rise) * rise;
+    float power = delayed_fraction * config->heater_power;
+
+    plant->temperature += (power - loss) / config->heat_capacity * step_s;
+
+    if (config->sensor_time_constant_s > 0.0f)
+    {
+        plant->sensor_temperature += (plant->temperature - plant->sensor_temperature) * step_s / config->sensor_time_constant_s;
+    }
+    else
+    {
+        plant->sensor_temperature = plant->temperature;
+    }
+}
+
+float thermal_plant_read_sensor(thermal_plant_t *plant)
+{
+    float reading = plant->sensor_temperature + plant->config.sensor_noise * next_gaussian(plant);
+
+    if (plant->config.sensor_resolution > 0.0f)
+    {
+        reading = roundf(reading / plant->config.sensor_resolution) * plant->config.sensor_resolution;
+    }
+
+    return reading;
+}
+
+/* Deterministic noise so scenario results are reproducible run to run. */
+static float next_gaussian(thermal_plant_t *plant)
+{
+    float sum = 0.0f;
+
+    for (int i = 0; i < 12; i++)
+    {
+        plant->noise_state = plant->noise_state * 1664525u + 1013904223u;
+        sum += (float)(plant->noise_state >> 8) / 16777216.0f;
+    }
+
+    return sum - 6.0f;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define THERMAL_PLANT_MAX_DELAY_STEPS 4096
+
+typedef struct
+{
+    float heat_capacity;          /* J/K */
+    float loss_coefficient;       /* W/K at ambient */
+    float loss_slope;             /* W/K^2, losses growing with temperature */
+    float heater_power;           /* W at 100 % */
+    float ambient_temperature;    /* C */
+    float transport_delay_s;
+    float sensor_time_constant_s;
+    float sensor_noise;           /* C, standard deviation */
+    float sensor_resolution;      /* C per LSB, 0 = none */
+} thermal_plant_config_t;
+
+typedef struct
+{
+    thermal_plant_config_t config;
+
+    float temperature;
+    float sensor_temperature;
+    float loss_factor;
+
+    float delay_line[THERMAL_PLANT_MAX_DELAY_STEPS];
+    uint32_t delay_steps;
+    uint32_t delay_index;
+
+    uint32_t noise_state;
+} thermal_plant_t;
+
+void thermal_plant_init(thermal_plant_t *plant, const thermal_plant_config_t *config, float initial_temperature, float step_s);
+void thermal_plant_step(thermal_plant_t *plant, float heater_fraction, float step_s);
+float thermal_plant_read_sensor(thermal_plant_t *plant);
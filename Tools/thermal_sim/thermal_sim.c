@@ -0,0 +1,515 @@
+/**
+ * Host-side closed-loop benchmark for the heater control logic
+ *
+ * Links App/heater/heater_control.c (and the PID, auto-tuner, program and
+ * metrics modules it uses) against the lumped model in thermal_plant.c and
+ * runs each scenario faster than real time. The firmware timing is
+ * reproduced: 125 ms TMP117 samples, the control period of heater.c and
+ * the 1 s TIM3 slow-PWM window with its 20 ms minimum on-time.
+ *
+ * Fault scenarios inject sensor and heater failures and check that the
+ * thermal supervisor reports the expected fault; the program exits non-zero
+ * when a fault is missed or a healthy scenario trips.
+ *
+ * Reset scenarios restart the controller at steady state, either cold with
+ * only the setpoint re-applied or from the state heater.c retains in SRAM2,
+ * and report the time back to regulation measured from the reset.
+ *
+ * Build from the repository root:
+ *   gcc -O2 -std=c11 -IApp/heater -ITools/thermal_sim \
+ *       Tools/thermal_sim/thermal_sim.c Tools/thermal_sim/thermal_plant.c \
+ *       App/heater/heater_control.c App/heater/pid_controller.c \
+ *       App/heater/autotune.c App/heater/setpoint_program.c \
+ *       App/heater/control_metrics.c App/heater/smith_predictor.c \
+ *       App/heater/thermal_supervisor.c -lm -o thermal_sim
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "heater_control.h"
+#include "thermal_plant.h"
+
+#define SIM_STEP_S 0.01f
+#define SENSOR_PERIOD_S 0.125f
+#define PWM_PERIOD_S 1.0f
+#define PWM_MIN_ON_S 0.02f
+#define SETTLING_BAND 0.5f
+#define SPIKE_SIZE 40.0f
+
+typedef enum
+{
+    INJECT_NONE,
+    INJECT_SENSOR_FREEZE,
+    INJECT_SENSOR_DROPOUT,
+    INJECT_SENSOR_SPIKE,
+    INJECT_HEATER_DETACHED,
+
+    INJECT_NUMBER,
+} fault_injection_t;
+
+typedef struct
+{
+    const char *name;
+    float initial_temperature;
+    float setpoint;
+    uint32_t cycle_time_ms;
+    float duration_s;
+
+    const setpoint_segment_t *program;
+    uint8_t program_length;
+
+    bool autotune;
+    autotune_rule_t autotune_rule;
+    heater_controller_t controller;
+
+    float step_time_s;
+    float step_setpoint;
+
+    float disturbance_time_s;
+    float disturbance_duration_s;
+    float disturbance_loss_factor;
+
+    fault_injection_t injection;
+    float injection_time_s;
+    thermal_fault_t expected_fault;
+
+    float reset_time_s;
+    bool reset_retained;
+} scenario_t;
+
+typedef struct
+{
+    control_metrics_t metrics;
+    float final_temperature;
+    bool autotune_ok;
+    autotune_result_t autotune_result;
+    smith_predictor_t smith;
+    thermal_fault_t fault;
+    float fault_time;
+} scenario_result_t;
+
+static const setpoint_segment_t thermal_cycle_program[] =
+{
+    { .type = SETPOINT_SEGMENT_RAMP, .target = 80.0f, .rate = 2.0f },
+    { .type = SETPOINT_SEGMENT_WAIT_BAND, .band = 0.5f, .duration_s = 900.0f },
+    { .type = SETPOINT_SEGMENT_HOLD, .duration_s = 600.0f },
+    { .type = SETPOINT_SEGMENT_RAMP, .target = 40.0f, .rate = 1.0f },
+    { .type = SETPOINT_SEGMENT_HOLD, .duration_s = 600.0f },
+    { .type = SETPOINT_SEGMENT_LOOP, .loop_to = 0, .loop_count = 1 },
+};
+
+static const scenario_t scenarios[] =
+{
+    {
+        .name = "step 22->50",
+        .initial_temperature = 22.0f, .setpoint = 50.0f,
+        .cycle_time_ms = 1000, .duration_s = 3600.0f,
+    },
+    {
+        .name = "step 22->50 100ms",
+        .initial_temperature = 22.0f, .setpoint = 50.0f,
+        .cycle_time_ms = 100, .duration_s = 3600.0f,
+    },
+    {
+        .name = "step 50->80",
+        .initial_temperature = 22.0f, .setpoint = 50.0f,
+        .cycle_time_ms = 1000, .duration_s = 7200.0f,
+        .step_time_s = 3600.0f, .step_setpoint = 80.0f,
+    },
+    {
+        .name = "door open at 50",
+        .initial_temperature = 22.0f, .setpoint = 50.0f,
+        .cycle_time_ms = 1000, .duration_s = 7200.0f,
+        .step_time_s = 3600.0f, .step_setpoint = 50.0f,
+        .disturbance_time_s = 3900.0f, .disturbance_duration_s = 300.0f, .disturbance_loss_factor = 3.0f,
+    },
+    {
+        .name = "thermal cycle",
+        .initial_temperature = 22.0f, .setpoint = 22.0f,
+        .cycle_time_ms = 1000, .duration_s = 14400.0f,
+        .program = thermal_cycle_program,
+        .program_length = sizeof(thermal_cycle_program) / sizeof(thermal_cycle_program[0]),
+    },
+    {
+        .name = "autotune ZN, 50->60",
+        .initial_temperature = 22.0f, .setpoint = 50.0f,
+        .cycle_time_ms = 1000, .duration_s = 3600.0f,
+        .autotune = true, .autotune_rule = AUTOTUNE_RULE_ZIEGLER_NICHOLS,
+        .step_time_s = 1200.0f, .step_setpoint = 60.0f,
+    },
+    {
+        .name = "autotune TL, 50->60",
+        .initial_temperature = 22.0f, .setpoint = 50.0f,
+        .cycle_time_ms = 1000, .duration_s = 3600.0f,
+        .autotune = true, .autotune_rule = AUTOTUNE_RULE_TYREUS_LUYBEN,
+        .step_time_s = 1200.0f, .step_setpoint = 60.0f,
+    },
+    {
+        .name = "autotune SIMC, 50->60",
+        .initial_temperature = 22.0f, .setpoint = 50.0f,
+        .cycle_time_ms = 1000, .duration_s = 3600.0f,
+        .autotune = true, .autotune_rule = AUTOTUNE_RULE_SIMC,
+        .step_time_s = 1200.0f, .step_setpoint = 60.0f,
+    },
+    {
+        .name = "smith, 50->60",
+        .initial_temperature = 22.0f, .setpoint = 50.0f,
+        .cycle_time_ms = 1000, .duration_s = 3600.0f,
+        .autotune = true, .autotune_rule = AUTOTUNE_RULE_SIMC, .controller = HEATER_CONTROLLER_SMITH,
+        .step_time_s = 1200.0f, .step_setpoint = 60.0f,
+    },
+    {
+        .name = "autotune SIMC, cycle",
+        .initial_temperature = 22.0f, .setpoint = 50.0f,
+        .cycle_time_ms = 1000, .duration_s = 14400.0f,
+        .autotune = true, .autotune_rule = AUTOTUNE_RULE_SIMC,
+        .step_time_s = 1200.0f,
+        .program = thermal_cycle_program,
+        .program_length = sizeof(thermal_cycle_program) / sizeof(thermal_cycle_program[0]),
+    },
+    {
+        .name = "smith, cycle",
+        .initial_temperature = 22.0f, .setpoint = 50.0f,
+        .cycle_time_ms = 1000, .duration_s = 14400.0f,
+        .autotune = true, .autotune_rule = AUTOTUNE_RULE_SIMC, .controller = HEATER_CONTROLLER_SMITH,
+        .step_time_s = 1200.0f,
+        .program = thermal_cycle_program,
+        .program_length = sizeof(thermal_cycle_program) / sizeof(thermal_cycle_program[0]),
+    },
+    {
+        .name = "reset at 80, cold",
+        .initial_temperature = 22.0f, .setpoint = 80.0f,
+        .cycle_time_ms = 1000, .duration_s = 7200.0f,
+        .reset_time_s = 3600.0f, .reset_retained = false,
+    },
+    {
+        .name = "reset at 80, retained",
+        .initial_temperature = 22.0f, .setpoint = 80.0f,
+        .cycle_time_ms = 1000, .duration_s = 7200.0f,
+        .reset_time_s = 3600.0f, .reset_retained = true,
+    },
+    {
+        .name = "fault: sensor frozen",
+        .initial_temperature = 22.0f, .setpoint = 50.0f,
+        .cycle_time_ms = 1000, .duration_s = 1800.0f,
+        .injection = INJECT_SENSOR_FREEZE, .injection_time_s = 100.0f,
+        .expected_fault = THERMAL_FAULT_SENSOR_STUCK,
+    },
+    {
+        .name = "fault: sensor dropout",
+        .initial_temperature = 22.0f, .setpoint = 50.0f,
+        .cycle_time_ms = 1000, .duration_s = 3600.0f,
+        .injection = INJECT_SENSOR_DROPOUT, .injection_time_s = 2400.0f,
+        .expected_fault = THERMAL_FAULT_SENSOR_STALE,
+    },
+    {
+        .name = "fault: sensor spike",
+        .initial_temperature = 22.0f, .setpoint = 50.0f,
+        .cycle_time_ms = 1000, .duration_s = 3600.0f,
+        .injection = INJECT_SENSOR_SPIKE, .injection_time_s = 2400.0f,
+        .expected_fault = THERMAL_FAULT_IMPLAUSIBLE_SLOPE,
+    },
+    {
+        .name = "fault: detached heating",
+        .initial_temperature = 22.0f, .setpoint = 50.0f,
+        .cycle_time_ms = 1000, .duration_s = 1800.0f,
+        .injection = INJECT_HEATER_DETACHED, .injection_time_s = 0.0f,
+        .expected_fault = THERMAL_FAULT_RUNAWAY,
+    },
+    {
+        .name = "fault: detached at 50",
+        .initial_temperature = 22.0f, .setpoint = 50.0f,
+        .cycle_time_ms = 1000, .duration_s = 5400.0f,
+        .injection = INJECT_HEATER_DETACHED, .injection_time_s = 2400.0f,
+        .expected_fault = THERMAL_FAULT_RUNAWAY,
+    },
+    {
+        .name = "fault: detached, tuned",
+        .initial_temperature = 22.0f, .setpoint = 50.0f,
+        .cycle_time_ms = 1000, .duration_s = 3600.0f,
+        .autotune = true, .autotune_rule = AUTOTUNE_RULE_SIMC,
+        .injection = INJECT_HEATER_DETACHED, .injection_time_s = 1200.0f,
+        .expected_fault = THERMAL_FAULT_RUNAWAY,
+    },
+};
+
+static thermal_plant_config_t plant_config =
+{
+    .heat_capacity = 2000.0f,
+    .loss_coefficient = 1.5f,
+    .loss_slope = 0.01f,
+    .heater_power = 250.0f,
+    .ambient_temperature = 22.0f,
+    .transport_delay_s = 15.0f,
+    .sensor_time_constant_s = 10.0f,
+    .sensor_noise = 0.02f,
+    .sensor_resolution = 0.0078125f,
+};
+
+static bool pwm_output(float duty, float time_s)
+{
+    float on_time = duty / 100.0f * PWM_PERIOD_S;
+
+    if (on_time <= 0.0f)
+    {
+        return false;
+    }
+
+    if (on_time < PWM_MIN_ON_S)
+    {
+        on_time = PWM_MIN_ON_S;
+    }
+
+    return fmodf(time_s, PWM_PERIOD_S) < on_time;
+}
+
+static void run_scenario(const scenario_t *scenario, scenario_result_t *result)
+{
+    static thermal_plant_t plant;
+    heater_control_t control;
+
+    thermal_plant_init(&plant, &plant_config, scenario->initial_temperature, SIM_STEP_S);
+    heater_control_init(&control);
+    control.pid_params.setpoint = scenario->setpoint;
+
+    float measured = thermal_plant_read_sensor(&plant);
+    control_metrics_reset(&control.metrics, scenario->setpoint, measured, SETTLING_BAND);
+
+    if (scenario->autotune)
+    {
+        heater_control_start_autotune(&control, scenario->autotune_rule);
+    }
+
+    float cycle_s = scenario->cycle_time_ms / 1000.0f;
+    float next_sample = 0.0f;
+    float next_control = 0.0f;
+    float step_time = scenario->autotune ? -1.0f : scenario->step_time_s;
+    bool step_pending = (scenario->step_time_s > 0.0f || scenario->program != NULL);
+    float duration = scenario->duration_s;
+    float duty = 0.0f;
+    float sample_time = 0.0f;
+    float injection_time = scenario->autotune ? -1.0f : scenario->injection_time_s;
+    bool reset_pending = (scenario->reset_time_s > 0.0f);
+
+    result->autotune_ok = false;
+    result->fault = THERMAL_FAULT_NONE;
+    result->fault_time = 0.0f;
+
+    for (float time_s = 0.0f; time_s < duration; time_s += SIM_STEP_S)
+    {
+        bool injected = scenario->injection != INJECT_NONE && injection_time >= 0.0f && time_s >= injection_time;
+
+        if (time_s >= next_sample)
+        {
+            float sample = thermal_plant_read_sensor(&plant);
+            next_sample += SENSOR_PERIOD_S;
+
+            /* A frozen sensor keeps answering with its last value, a dropped one stops answering. */
+            if (!injected || scenario->injection == INJECT_HEATER_DETACHED)
+            {
+                measured = sample;
+                sample_time = time_s;
+            }
+            else if (scenario->injection == INJECT_SENSOR_FREEZE)
+            {
+                sample_time = time_s;
+            }
+            else if (scenario->injection == INJECT_SENSOR_SPIKE)
+            {
+                measured = sample + ((time_s - injection_time < cycle_s) ? SPIKE_SIZE : 0.0f);
+                sample_time = time_s;
+            }
+        }
+
+        /* The outputs are off from the reset until the first control cycle, which runs at once. */
+        if (reset_pending && time_s >= scenario->reset_time_s)
+        {
+            heater_control_retained_t retained;
+
+            heater_control_retain(&control, &retained);
+            heater_control_init(&control);
+
+            if (!scenario->reset_retained || !heater_control_restore(&control, &retained))
+            {
+                control.pid_params.setpoint = retained.setpoint;
+            }
+
+            control_metrics_reset(&control.metrics, control.pid_params.setpoint, measured, SETTLING_BAND);
+            duty = 0.0f;
+            next_control = time_s;
+            reset_pending = false;
+        }
+
+        if (time_s >= next_control)
+        {
+            bool autotuning = (control.mode == HEATER_MODE_AUTOTUNE);
+            thermal_fault_t fault = heater_control_supervise(&control, measured, time_s - sample_time, cycle_s);
+
+            if (fault != THERMAL_FAULT_NONE && result->fault == THERMAL_FAULT_NONE)
+            {
+                result->fault = fault;
+                result->fault_time = injected ? time_s - injection_time : time_s;
+            }
+
+            duty = heater_control_update(&control, measured, cycle_s);
+            next_control += cycle_s;
+
+            /* Time the setpoint step from the end of the auto-tune run. */
+            if (autotuning && control.mode != HEATER_MODE_AUTOTUNE)
+            {
+                result->autotune_ok = autotune_get_result(&control.autotune, &result->autotune_result);
+                heater_control_select_controller(&control, scenario->controller);
+                step_time = time_s + scenario->step_time_s;
+                duration = time_s + scenario->duration_s;
+                injection_time = time_s + scenario->injection_time_s;
+            }
+        }
+
+        /* Programs and setpoint steps start at the step time. */
+        if (step_pending && step_time >= 0.0f && time_s >= step_time)
+        {
+            if (scenario->program != NULL)
+            {
+                heater_control_start_program(&control, scenario->program, scenario->program_length, measured);
+            }
+            else
+            {
+                control.pid_params.setpoint = scenario->step_setpoint;
+                control_metrics_reset(&control.metrics, scenario->step_setpoint, measured, SETTLING_BAND);
+            }
+
+            step_pending = false;
+        }
+
+        float disturbance_end = scenario->disturbance_time_s + scenario->disturbance_duration_s;
+        bool disturbed = scenario->disturbance_duration_s > 0.0f && time_s >= scenario->disturbance_time_s && time_s < disturbance_end;
+        plant.loss_factor = disturbed ? scenario->disturbance_loss_factor : 1.0f;
+
+        bool heater_on = pwm_output(duty, time_s);
+        control_metrics_record_output(&control.metrics, heater_on);
+        bool detached = injected && scenario->injection == INJECT_HEATER_DETACHED;
+        thermal_plant_step(&plant, (heater_on && !detached) ? 1.0f : 0.0f, SIM_STEP_S);
+    }
+
+    result->metrics = control.metrics;
+    result->smith = control.smith;
+    result->final_temperature = plant.temperature;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [-C heat_capacity] [-G loss_W_per_K] [-L loss_slope] [-P heater_W]\n"
+            "          [-a ambient_C] [-d delay_s] [-s sensor_tau_s] [-n noise_C] [-f name_filter]\n",
+            program);
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = NULL;
+    int failures = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "C:G:L:P:a:d:s:n:f:h")) != -1)
+    {
+        switch (option)
+        {
+            case 'C': plant_config.heat_capacity = strtof(optarg, NULL); break;
+            case 'G': plant_config.loss_coefficient = strtof(optarg, NULL); break;
+            case 'L': plant_config.loss_slope = strtof(optarg, NULL); break;
+            case 'P': plant_config.heater_power = strtof(optarg, NULL); break;
+            case 'a': plant_config.ambient_temperature = strtof(optarg, NULL); break;
+            case 'd': plant_config.transport_delay_s = strtof(optarg, NULL); break;
+            case 's': plant_config.sensor_time_constant_s = strtof(optarg, NULL); break;
+            case 'n': plant_config.sensor_noise = strtof(optarg, NULL); break;
+            case 'f': filter = optarg; break;
+            default:
+                usage(argv[0]);
+                return (option == 'h') ? 0 : 1;
+        }
+    }
+
+    printf("plant: C=%.0f J/K G=%.2f W/K L=%.3f W/K^2 P=%.0f W delay=%.1f s sensor tau=%.1f s noise=%.3f C\n\n",
+           plant_config.heat_capacity, plant_config.loss_coefficient, plant_config.loss_slope,
+           plant_config.heater_power, plant_config.transport_delay_s,
+           plant_config.sensor_time_constant_s, plant_config.sensor_noise);
+
+    printf("%-24s %10s %10s %10s %10s %9s %8s  %s\n", "scenario", "settle[s]", "overshoot", "IAE", "ISE", "switches", "final", "fault");
+
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+    {
+        const scenario_t *scenario = &scenarios[i];
+        scenario_result_t result;
+
+        if (filter != NULL && strstr(scenario->name, filter) == NULL)
+        {
+            continue;
+        }
+
+        run_scenario(scenario, &result);
+
+        bool fault_ok = (result.fault == scenario->expected_fault);
+        failures += fault_ok ? 0 : 1;
+
+        printf("%-24s %10.0f %10.2f %10.1f %10.1f %9u %8.2f  %s",
+               scenario->name,
+               result.metrics.settling_time,
+               result.metrics.overshoot,
+               result.metrics.iae,
+               result.metrics.ise,
+               (unsigned)result.metrics.switch_count,
+               result.final_temperature,
+               thermal_supervisor_fault_name(result.fault));
+
+        if (result.fault != THERMAL_FAULT_NONE)
+        {
+            printf(" after %.0fs", result.fault_time);
+        }
+
+        printf("%s\n", fault_ok ? "" : " (UNEXPECTED)");
+
+        if (scenario->autotune)
+        {
+            if (result.autotune_ok && scenario->controller == HEATER_CONTROLLER_SMITH)
+            {
+                printf("%-24s model K=%.3f k'=%.5f tau=%.0fs theta=%.1fs -> kp=%.2f ki=%.4f\n", "",
+                       result.smith.model_gain, result.smith.model.integrating_gain,
+                       result.smith.model_time_constant, result.smith.model.dead_time,
+                       result.smith.pid.kp, result.smith.pid.ki);
+            }
+            else if (result.autotune_ok && result.autotune_result.time_constant > 0.0f)
+            {
+                printf("%-24s Ku=%.2f Pu=%.0fs theta=%.1fs K=%.3f tau=%.0fs -> kp=%.2f ki=%.4f kd=%.2f\n", "",
+                       result.autotune_result.ultimate_gain, result.autotune_result.ultimate_period,
+                       result.autotune_result.dead_time, result.autotune_result.process_gain,
+                       result.autotune_result.time_constant, result.autotune_result.kp,
+                       result.autotune_result.ki, result.autotune_result.kd);
+            }
+            else if (result.autotune_ok)
+            {
+                /* The lag could not be separated from the gain, so the tuner used an integrating model. */
+                printf("%-24s Ku=%.2f Pu=%.0fs theta=%.1fs integrating k'=%.5f -> kp=%.2f ki=%.4f kd=%.2f\n", "",
+                       result.autotune_result.ultimate_gain, result.autotune_result.ultimate_period,
+                       result.autotune_result.dead_time, result.autotune_result.integrating_gain,
+                       result.autotune_result.kp, result.autotune_result.ki, result.autotune_result.kd);
+            }
+            else
+            {
+                printf("%-24s auto-tune failed\n", "");
+            }
+        }
+    }
+
+    if (failures > 0)
+    {
+        printf("\n%d scenario(s) with an unexpected supervisor result\n", failures);
+    }
+
+    return (failures == 0) ? 0 : 1;
+}